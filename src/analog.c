@@ -259,6 +259,51 @@ void deadzone_trigger_calc(int *analog, int analog_in)
 }
 
 
+#ifdef GPTK2_FIXED_POINT_DEADZONE
+
+void deadzone_mouse_calc(int *x, int *y, int in_x, int in_y)
+{   // the axes and the deadzone are already Q15, see analog_fixed.c.
+    vector2q vec2q_input = {in_x, in_y};
+    vector2q vec2q_output = {0, 0};
+
+    Sint32 dz = current_state.deadzone_x;
+
+    switch(current_state.deadzone_mode)
+    {
+    default:
+    case DZ_DEFAULT:
+    case DZ_AXIAL:
+        dzq_axial(&vec2q_output, &vec2q_input, dz);
+        break;
+
+    case DZ_RADIAL:
+        dzq_radial(&vec2q_output, &vec2q_input, dz);
+        break;
+
+    case DZ_SCALED_RADIAL:
+        dzq_scaled_radial(&vec2q_output, &vec2q_input, dz);
+        break;
+
+    case DZ_SLOPED_AXIAL:
+        dzq_sloped_axial(&vec2q_output, &vec2q_input, dz);
+        break;
+
+    case DZ_SLOPED_SCALED_AXIAL:
+        dzq_sloped_scaled_axial(&vec2q_output, &vec2q_input, dz);
+        break;
+
+    case DZ_HYBRID:
+        dzq_hybrid(&vec2q_output, &vec2q_input, dz);
+        break;
+    }
+
+    // truncated towards zero, same as the float version.
+    *x = (int)(((Sint64)vec2q_output.x * current_state.deadzone_scale) / 32768);
+    *y = (int)(((Sint64)vec2q_output.y * current_state.deadzone_scale) / 32768);
+}
+
+#else
+
 void deadzone_mouse_calc(int *x, int *y, int in_x, int in_y)
 {
     vector2d vec2d_input;
@@ -302,3 +347,4 @@ void deadzone_mouse_calc(int *x, int *y, int in_x, int in_y)
     *y = (int)(vec2d_ouput.y * (float)current_state.deadzone_scale);
 }
 
+#endif
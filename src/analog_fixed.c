@@ -0,0 +1,287 @@
+/* Copyright (c) 2021-2024
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 2 of the License, or (at your option) any later version.
+#
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+#
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA 02110-1301 USA
+#
+* Authored by: Kris Henriksen <krishenriksen.work@gmail.com>
+#
+* AnberPorts-Keyboard-Mouse
+*
+* Part of the code is from from https://github.com/krishenriksen/AnberPorts/blob/master/AnberPorts-Keyboard-Mouse/main.c (mostly the fake keyboard)
+* Fake Xbox code from: https://github.com/Emanem/js2xbox
+*
+* Modified (badly) by: Shanti Gilbert for EmuELEC
+* Modified further by: Nikolai Wuttke for EmuELEC (Added support for SDL and the SDLGameControllerdb.txt)
+* Modified further by: Jacob Smith
+*
+* Any help improving this code would be greatly appreciated!
+*
+* DONE: Xbox360 mode: Fix triggers so that they report from 0 to 255 like real Xbox triggers
+*       Xbox360 mode: Figure out why the axis are not correctly labeled?  SDL_CONTROLLER_AXIS_RIGHTX / SDL_CONTROLLER_AXIS_RIGHTY / SDL_CONTROLLER_AXIS_TRIGGERLEFT / SDL_CONTROLLER_AXIS_TRIGGERRIGHT
+*       Keyboard mode: Add a config file option to load mappings from.
+*       add L2/R2 triggers
+*
+*/
+
+#include "gptokeyb2.h"
+
+/* Fixed point versions of the deadzones in analog.c for cpus with a slow
+ * fpu, only built with -DGPTK2_FIXED_POINT_DEADZONE=ON and for the tests.
+ * Everything is Q15 (32768 is 1.0), which is what SDL gives us for the axes
+ * anyway, so the sums of squares still fit in 32 bits and only the scaling
+ * needs 64 bit products.
+ *
+ * tests/deadzone_test.c holds them to the float versions for deadzones up
+ * to half the stick. Where the float code would divide by zero, or by a
+ * negative number in hybrid with bigger deadzones, the output is left at
+ * zero instead.
+ */
+
+#define Q15_SHIFT 15
+#define Q15_ONE   (1 << Q15_SHIFT)
+
+// 2^(1/2), 2^(1/4) .. 2^(1/65536) in Q30, for q15_exp2().
+static const Uint32 q30_exp2_steps[16] = {
+    1518500250, 1276901417, 1170923762, 1121280436,
+    1097253708, 1085434106, 1079572136, 1076653033,
+    1075196443, 1074468888, 1074105294, 1073923544,
+    1073832680, 1073787251, 1073764537, 1073753181,
+};
+
+
+static Uint32 q15_isqrt(Uint32 value)
+{   // sqrt(value) rounded to nearest, a bit at a time so there are no divides.
+    Uint32 result = 0;
+    Uint32 bit = 1u << 30;
+
+    while (bit > value)
+        bit >>= 2;
+
+    while (bit != 0)
+    {
+        if (value >= result + bit)
+        {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        }
+        else
+        {
+            result >>= 1;
+        }
+
+        bit >>= 2;
+    }
+
+    // value is what is left over from result squared.
+    if (value > result)
+        result++;
+
+    return result;
+}
+
+
+static Sint32 q15_div(Sint64 numerator, Sint64 denominator)
+{   // rounded to nearest, denominator has to be positive.
+    if (numerator < 0)
+        return (Sint32)((numerator - denominator / 2) / denominator);
+
+    return (Sint32)((numerator + denominator / 2) / denominator);
+}
+
+
+static Uint32 q15_length_sq(const vector2q *vec2q)
+{   // in Q30, both axes at -32768 is still only 2^31.
+    return (Uint32)(vec2q->x * vec2q->x) + (Uint32)(vec2q->y * vec2q->y);
+}
+
+
+static Sint32 q15_log2(Uint32 value)
+{   // log2 of a positive Q15 value, in Q16.
+    int msb = 31 - __builtin_clz(value);
+    Sint32 result = (msb - Q15_SHIFT) * 65536;
+
+    // normalise to [1, 2) in Q30, then square it once per fraction bit.
+    Uint64 mantissa = ((Uint64)value << 30) >> msb;
+
+    for (int i=0; i < 16; i++)
+    {
+        mantissa = (mantissa * mantissa) >> 30;
+
+        if (mantissa >= (2ull << 30))
+        {
+            mantissa >>= 1;
+            result += (0x8000 >> i);
+        }
+    }
+
+    return result;
+}
+
+
+static Sint32 q15_exp2(Sint32 value)
+{   // 2 to the power of a Q16 value, in Q15. saturates instead of overflowing.
+    Sint32 whole = (value >= 0) ? (value / 65536) : -((65535 - value) / 65536);
+    Sint32 fraction = value - whole * 65536;
+    Uint64 result = (Uint64)1 << 30;
+
+    for (int i=0; i < 16; i++)
+    {
+        if (fraction & (0x8000 >> i))
+            result = (result * q30_exp2_steps[i]) >> 30;
+    }
+
+    // result is in [1, 2) in Q30.
+    if (whole > Q15_SHIFT)
+        return INT32_MAX;
+
+    if (whole < Q15_SHIFT - 62)
+        return 0;
+
+    return (Sint32)(result >> (Q15_SHIFT - whole));
+}
+
+
+static Sint32 q15_pow(Sint32 value, Sint32 power)
+{   // value (Q15) to the power (Q16).
+    Sint64 exponent = ((Sint64)q15_log2((Uint32)value) * power) / 65536;
+
+    if (exponent > INT32_MAX / 2)
+        return INT32_MAX;
+
+    if (exponent < INT32_MIN / 2)
+        return 0;
+
+    return q15_exp2((Sint32)exponent);
+}
+
+
+static Sint32 q15_sign(Sint32 value)
+{
+    return ((value < 0) ? -1 : 1);
+}
+
+
+static bool q15_outside_radius(const vector2q *vec2q, Sint32 deadzone)
+{   // magnitude >= deadzone, compared squared so there is no square root.
+    return ((Uint64)q15_length_sq(vec2q) >= (Uint64)((Sint64)deadzone * deadzone));
+}
+
+
+static Sint32 q15_map_deadzone(Sint32 value, Sint32 deadzone)
+{   // map_range(value, deadzone, 1.0, 0.0, 1.0)
+    return q15_div((Sint64)(value - deadzone) << Q15_SHIFT, Q15_ONE - deadzone);
+}
+
+
+void dzq_axial(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone)
+{
+    if (abs(vec2q_input->x) > deadzone)
+        vec2q_output->x = vec2q_input->x;
+
+    if (abs(vec2q_input->y) > deadzone)
+        vec2q_output->y = vec2q_input->y;
+}
+
+
+void dzq_radial(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone)
+{
+    if (q15_outside_radius(vec2q_input, deadzone))
+        *vec2q_output = *vec2q_input;
+}
+
+
+void dzq_scaled_radial(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone)
+{
+    if (deadzone >= Q15_ONE || !q15_outside_radius(vec2q_input, deadzone))
+        return;
+
+    Sint32 input_magnitude = (Sint32)q15_isqrt(q15_length_sq(vec2q_input));
+
+    if (input_magnitude == 0)
+        return;
+
+    Sint32 range_scale = q15_map_deadzone(input_magnitude, deadzone);
+
+    vec2q_output->x = q15_div((Sint64)vec2q_input->x * range_scale, input_magnitude);
+    vec2q_output->y = q15_div((Sint64)vec2q_input->y * range_scale, input_magnitude);
+}
+
+
+void dzq_sloped_axial(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone)
+{
+    Sint64 abs_x = abs(vec2q_input->x);
+    Sint64 abs_y = abs(vec2q_input->y);
+
+    *vec2q_output = *vec2q_input;
+
+    // |x| < deadzone * |x|, without losing the bits below Q15.
+    if ((abs_x << Q15_SHIFT) < deadzone * abs_x)
+        vec2q_output->x = 0;
+
+    if ((abs_y << Q15_SHIFT) < deadzone * abs_y)
+        vec2q_output->y = 0;
+}
+
+
+void dzq_sloped_scaled_axial(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone)
+{
+    Sint32 abs_x = abs(vec2q_input->x);
+    Sint32 abs_y = abs(vec2q_input->y);
+    Sint32 deadzone_x = q15_div((Sint64)deadzone * abs_x, Q15_ONE);
+    Sint32 deadzone_y = q15_div((Sint64)deadzone * abs_y, Q15_ONE);
+
+    if (abs_x > deadzone_x && deadzone_x < Q15_ONE)
+        vec2q_output->x = q15_sign(vec2q_input->x) * q15_map_deadzone(abs_x, deadzone_x);
+
+    if (abs_y > deadzone_y && deadzone_y < Q15_ONE)
+        vec2q_output->y = q15_sign(vec2q_input->y) * q15_map_deadzone(abs_y, deadzone_y);
+}
+
+
+void dzq_hybrid(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone)
+{
+    vector2q partial_output = {0, 0};
+
+    if (!q15_outside_radius(vec2q_input, deadzone))
+        return;
+
+    dzq_scaled_radial(&partial_output, vec2q_input, deadzone);
+
+    dzq_sloped_scaled_axial(vec2q_output, &partial_output, deadzone);
+}
+
+
+void dzq_exp(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone, Sint32 n)
+{   // n is in Q16. the scaled radial output points the same way as the input and its
+    // magnitude is the range scale, so we go straight from the input and round once.
+    if (deadzone >= Q15_ONE || !q15_outside_radius(vec2q_input, deadzone))
+        return;
+
+    Sint32 input_magnitude = (Sint32)q15_isqrt(q15_length_sq(vec2q_input));
+
+    if (input_magnitude == 0)
+        return;
+
+    Sint32 range_scale = q15_map_deadzone(input_magnitude, deadzone);
+
+    // < 0.0001
+    if ((Sint64)range_scale * 10000 < Q15_ONE)
+        return;
+
+    Sint32 power = q15_pow(range_scale, n);
+
+    vec2q_output->x = q15_div((Sint64)vec2q_input->x * power, input_magnitude);
+    vec2q_output->y = q15_div((Sint64)vec2q_input->y * power, input_magnitude);
+}
@@ -0,0 +1,688 @@
+/* Copyright (c) 2021-2024
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 2 of the License, or (at your option) any later version.
+#
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+#
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA 02110-1301 USA
+#
+* Authored by: Kris Henriksen <krishenriksen.work@gmail.com>
+#
+* AnberPorts-Keyboard-Mouse
+*
+* Part of the code is from from https://github.com/krishenriksen/AnberPorts/blob/master/AnberPorts-Keyboard-Mouse/main.c (mostly the fake keyboard)
+* Fake Xbox code from: https://github.com/Emanem/js2xbox
+*
+* Modified (badly) by: Shanti Gilbert for EmuELEC
+* Modified further by: Nikolai Wuttke for EmuELEC (Added support for SDL and the SDLGameControllerdb.txt)
+* Modified further by: Jacob Smith
+*
+* Any help improving this code would be greatly appreciated!
+*
+* DONE: Xbox360 mode: Fix triggers so that they report from 0 to 255 like real Xbox triggers
+*       Xbox360 mode: Figure out why the axis are not correctly labeled?  SDL_CONTROLLER_AXIS_RIGHTX / SDL_CONTROLLER_AXIS_RIGHTY / SDL_CONTROLLER_AXIS_TRIGGERLEFT / SDL_CONTROLLER_AXIS_TRIGGERRIGHT
+*       Keyboard mode: Add a config file option to load mappings from.
+*       add L2/R2 triggers
+*
+*/
+
+#include "gptokeyb2.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Compiled config cache.
+ *
+ * `--compile` loads the config as usual, finalises it and writes everything it
+ * produced into <config>.cache. Later runs mmap that file instead of parsing the
+ * text again, as long as the config file, game prefix, hotkey and text input mode
+ * are the same as when it was compiled.
+ *
+ * The file is a header followed by flat tables, configs refer to each other by
+ * index and every string is an offset into the string pool at the end.
+ */
+
+#define CACHE_MAGIC   0x4B545047 // "GPTK"
+#define CACHE_VERSION 1
+#define CACHE_SUFFIX  ".cache"
+#define CACHE_ALIGN   8
+
+typedef struct
+{
+    Uint32 magic;
+    Uint32 version;
+    Uint32 file_size;
+    Uint32 gbtn_max;
+
+    // what the cache was built from.
+    Uint64 source_size;
+    Sint64 source_mtime_sec;
+    Sint64 source_mtime_nsec;
+    Sint32 hotkey_gbtn;
+    Uint32 text_input;
+    Uint32 program_version;
+    Uint32 game_prefix;
+
+    // globals
+    Uint32 default_control;
+    Uint32 hk_can_fix;
+
+    Uint32 settings_count;
+    Uint32 settings_offset;
+    Uint32 configs_count;
+    Uint32 configs_offset;
+    Uint32 char_sets_count;
+    Uint32 char_sets_offset;
+    Uint32 word_sets_count;
+    Uint32 word_sets_offset;
+    Uint32 words_count;
+    Uint32 words_offset;
+    Uint32 strings_size;
+    Uint32 strings_offset;
+} cache_header;
+
+typedef struct
+{
+    Uint32 name;
+    Uint32 unused;
+    Sint64 value;
+} cache_setting;
+
+typedef struct
+{
+    Sint16 keycode;
+    Sint16 modifier;
+    Sint32 repeat;
+    Sint32 action;
+    Sint32 special;
+    Uint32 cfg_name;
+    Sint32 cfg_map;     // config index, -1 for none
+} cache_button;
+
+typedef struct
+{
+    Uint32 name;
+    Uint32 charset;
+    Uint32 wordset;
+
+    Sint32 overlay_mode;
+    Sint32 exclusive_mode;
+
+    Sint32 left_analog_as_mouse;
+    Sint32 right_analog_as_mouse;
+    Sint32 dpad_as_mouse;
+
+    Sint32 left_analog_as_absolute_mouse;
+    Sint32 right_analog_as_absolute_mouse;
+
+    Uint32 mouse_wheel_amount;
+
+    cache_button button[GBTN_MAX];
+} cache_config;
+
+typedef struct
+{
+    Uint32 name;
+    Uint32 characters;
+} cache_char_set;
+
+typedef struct
+{
+    Uint32 name;
+    Uint32 first_word;
+    Uint32 words_len;
+} cache_word_set;
+
+typedef struct
+{
+    char *data;
+    size_t size;
+    size_t alloc;
+} cache_buffer;
+
+
+static char cache_source[PATH_MAX] = "";
+static char cache_game_prefix[MAX_CONTROL_NAME] = "";
+static int cache_hotkey_gbtn = -1;
+
+
+static void cache_buffer_add(cache_buffer *buffer, const void *data, size_t size)
+{
+    if (buffer->size + size > buffer->alloc)
+    {
+        size_t new_alloc = (buffer->alloc > 0) ? buffer->alloc : 1024;
+
+        while (buffer->size + size > new_alloc)
+            new_alloc *= 2;
+
+        buffer->data = (char *)gptk_realloc(buffer->data, buffer->alloc, new_alloc);
+        buffer->alloc = new_alloc;
+    }
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+
+static Uint32 cache_buffer_align(cache_buffer *buffer)
+{   // pad to CACHE_ALIGN, returns the new size.
+    static const char padding[CACHE_ALIGN] = {0};
+
+    if ((buffer->size % CACHE_ALIGN) != 0)
+        cache_buffer_add(buffer, padding, CACHE_ALIGN - (buffer->size % CACHE_ALIGN));
+
+    return (Uint32)buffer->size;
+}
+
+
+static Uint32 cache_string_add(cache_buffer *strings, const char *string)
+{   // 0 is NULL, so the pool always starts with a spare byte.
+    if (string == NULL)
+        return 0;
+
+    if (strings->size == 0)
+        cache_buffer_add(strings, "", 1);
+
+    Uint32 offset = (Uint32)strings->size;
+    cache_buffer_add(strings, string, strlen(string) + 1);
+
+    return offset;
+}
+
+
+static bool cache_text_input()
+{
+    const char *env_textinput = SDL_getenv("TEXTINPUTINTERACTIVE");
+
+    return (env_textinput != NULL && atob_default(env_textinput, true));
+}
+
+
+static void cache_path(char *path, size_t path_size)
+{
+    snprintf(path, path_size, "%s" CACHE_SUFFIX, cache_source);
+}
+
+
+void cache_prepare(const char *file_name)
+{   // remember the config and everything that changes how it parses.
+    strncpy(cache_source, file_name, PATH_MAX - 1);
+    strncpy(cache_game_prefix, game_prefix, MAX_CONTROL_NAME - 1);
+    cache_hotkey_gbtn = current_state.hotkey_gbtn;
+}
+
+
+static int cache_config_index(const gptokeyb_config *config)
+{
+    int index = 0;
+
+    for (const gptokeyb_config *current = root_config; current != NULL; current = current->next, index++)
+    {
+        if (current == config)
+            return index;
+    }
+
+    return -1;
+}
+
+
+bool cache_save()
+{   // write out the finalised configs.
+    char path[PATH_MAX + sizeof(CACHE_SUFFIX)];
+    char temp_path[PATH_MAX + sizeof(CACHE_SUFFIX) + 4];
+    struct stat source_stat;
+
+    if (strlen(cache_source) == 0)
+    {
+        fprintf(stderr, "cache: no config to compile.\n");
+        return false;
+    }
+
+    if (stat(cache_source, &source_stat) != 0)
+    {
+        fprintf(stderr, "cache: unable to stat '%s': %s\n", cache_source, strerror(errno));
+        return false;
+    }
+
+    cache_header header;
+    cache_buffer tables = {NULL, 0, 0};
+    cache_buffer strings = {NULL, 0, 0};
+
+    memset(&header, 0, sizeof(header));
+
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.gbtn_max = GBTN_MAX;
+
+    header.source_size = (Uint64)source_stat.st_size;
+    header.source_mtime_sec = (Sint64)source_stat.st_mtim.tv_sec;
+    header.source_mtime_nsec = (Sint64)source_stat.st_mtim.tv_nsec;
+    header.hotkey_gbtn = cache_hotkey_gbtn;
+    header.text_input = cache_text_input();
+    header.program_version = cache_string_add(&strings, GPTK2_VERSION);
+    header.game_prefix = cache_string_add(&strings, cache_game_prefix);
+
+    header.default_control = cache_string_add(&strings, default_control_name);
+    header.hk_can_fix = (gptk_hk_can_fix != 0);
+
+    // tables are laid out straight after the header.
+    cache_buffer_add(&tables, &header, sizeof(header));
+
+    header.settings_offset = cache_buffer_align(&tables);
+
+    for (size_t i=0; i < config_setting_count(); i++)
+    {
+        cache_setting setting;
+        const char *name;
+
+        memset(&setting, 0, sizeof(setting));
+
+        if (!config_setting_get(i, &name, &setting.value))
+            continue;
+
+        setting.name = cache_string_add(&strings, name);
+        cache_buffer_add(&tables, &setting, sizeof(setting));
+        header.settings_count++;
+    }
+
+    header.configs_offset = cache_buffer_align(&tables);
+
+    for (const gptokeyb_config *current = root_config; current != NULL; current = current->next)
+    {
+        cache_config config;
+
+        memset(&config, 0, sizeof(config));
+
+        config.name    = cache_string_add(&strings, current->name);
+        config.charset = cache_string_add(&strings, current->charset);
+        config.wordset = cache_string_add(&strings, current->wordset);
+
+        config.overlay_mode   = current->overlay_mode;
+        config.exclusive_mode = current->exclusive_mode;
+
+        config.left_analog_as_mouse  = current->left_analog_as_mouse;
+        config.right_analog_as_mouse = current->right_analog_as_mouse;
+        config.dpad_as_mouse         = current->dpad_as_mouse;
+
+        config.left_analog_as_absolute_mouse  = current->left_analog_as_absolute_mouse;
+        config.right_analog_as_absolute_mouse = current->right_analog_as_absolute_mouse;
+
+        config.mouse_wheel_amount = current->mouse_wheel_amount;
+
+        for (int btn=0; btn < GBTN_MAX; btn++)
+        {
+            const gptokeyb_button *button = &current->button[btn];
+
+            config.button[btn].keycode  = button->keycode;
+            config.button[btn].modifier = button->modifier;
+            config.button[btn].repeat   = button->repeat;
+            config.button[btn].action   = button->action;
+            config.button[btn].special  = button->special;
+            config.button[btn].cfg_name = cache_string_add(&strings, button->cfg_name);
+            config.button[btn].cfg_map  = cache_config_index(button->cfg_map);
+        }
+
+        cache_buffer_add(&tables, &config, sizeof(config));
+        header.configs_count++;
+    }
+
+    header.char_sets_offset = cache_buffer_align(&tables);
+
+    for (const char_set *current = root_char_set; current != NULL; current = current->next)
+    {
+        cache_char_set set;
+
+        if (current->builtin)
+            continue;
+
+        set.name       = cache_string_add(&strings, current->name);
+        set.characters = cache_string_add(&strings, current->characters);
+
+        cache_buffer_add(&tables, &set, sizeof(set));
+        header.char_sets_count++;
+    }
+
+    header.word_sets_offset = cache_buffer_align(&tables);
+
+    for (const word_set *current = root_word_set; current != NULL; current = current->next)
+    {
+        cache_word_set set;
+
+        set.name       = cache_string_add(&strings, current->name);
+        set.first_word = header.words_count;
+        set.words_len  = (Uint32)current->words_len;
+
+        cache_buffer_add(&tables, &set, sizeof(set));
+        header.word_sets_count++;
+        header.words_count += set.words_len;
+    }
+
+    header.words_offset = cache_buffer_align(&tables);
+
+    for (const word_set *current = root_word_set; current != NULL; current = current->next)
+    {
+        for (size_t i=0; i < current->words_len; i++)
+        {
+            Uint32 word = cache_string_add(&strings, current->words[i]);
+
+            cache_buffer_add(&tables, &word, sizeof(word));
+        }
+    }
+
+    header.strings_offset = cache_buffer_align(&tables);
+    header.strings_size = (Uint32)strings.size;
+
+    cache_buffer_add(&tables, strings.data, strings.size);
+
+    header.file_size = (Uint32)tables.size;
+    memcpy(tables.data, &header, sizeof(header));
+
+    // write it next to the config, replacing any old cache in one go.
+    cache_path(path, sizeof(path));
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    bool result = false;
+    FILE *fp = fopen(temp_path, "wb");
+
+    if (fp == NULL)
+    {
+        fprintf(stderr, "cache: unable to create '%s': %s\n", temp_path, strerror(errno));
+    }
+    else
+    {
+        bool written = (fwrite(tables.data, 1, tables.size, fp) == tables.size);
+
+        if (fclose(fp) != 0)
+            written = false;
+
+        if (!written || rename(temp_path, path) != 0)
+        {
+            fprintf(stderr, "cache: unable to write '%s': %s\n", path, strerror(errno));
+            unlink(temp_path);
+        }
+        else
+        {
+            printf("Compiled '%s' to '%s' (%zu bytes, %u configs)\n",
+                cache_source, path, tables.size, header.configs_count);
+            result = true;
+        }
+    }
+
+    free(tables.data);
+    free(strings.data);
+
+    return result;
+}
+
+
+static const void *cache_table(const cache_header *header, Uint32 offset, Uint32 count, size_t size)
+{   // bounds checked pointer to a table in the mapped file.
+    if ((offset % CACHE_ALIGN) != 0 || offset < sizeof(cache_header) || offset > header->file_size)
+        return NULL;
+
+    if ((Uint64)count * size > (Uint64)(header->file_size - offset))
+        return NULL;
+
+    return (const char *)header + offset;
+}
+
+
+static bool cache_strings_valid(const cache_header *header, const Uint32 *offsets, size_t count, bool required)
+{   // string offsets have to be inside the pool, required strings can't be NULL.
+    for (size_t i=0; i < count; i++)
+    {
+        if (offsets[i] >= header->strings_size || (required && offsets[i] == 0))
+            return false;
+    }
+
+    return true;
+}
+
+
+static bool cache_mouse_mode_valid(Sint32 mode)
+{
+    return (mode >= MOUSE_MOVEMENT_PARENT && mode <= MOUSE_MOVEMENT_ON);
+}
+
+
+static bool cache_button_valid(const cache_header *header, const cache_button *button)
+{   // anything in here gets used as an array index later on.
+    if (button->keycode < 0 || button->keycode > KEY_MAX ||
+        (button->modifier & ~(MOD_SHIFT | MOD_CTRL | MOD_ALT)) != 0 ||
+        button->action < ACT_NONE || button->action > ACT_STATE_SET ||
+        button->special < SPC_NONE || button->special > SPC_CANCEL_INPUT)
+        return false;
+
+    if (!cache_strings_valid(header, &button->cfg_name, 1, false) ||
+        button->cfg_map < -1 || button->cfg_map >= (Sint32)header->configs_count)
+        return false;
+
+    // finalised state actions always have somewhere to go.
+    if (button->action >= ACT_STATE_HOLD && (button->cfg_name == 0 || button->cfg_map < 0))
+        return false;
+
+    return true;
+}
+
+
+#define CACHE_TABLE(type, name) \
+    ((const type *)cache_table(header, header->name ## _offset, header->name ## _count, sizeof(type)))
+
+#define CACHE_STRING(offset) ((offset) == 0 ? NULL : strings + (offset))
+
+
+static bool cache_check(const cache_header *header, size_t file_size, const struct stat *source_stat)
+{   // make sure the cache is current and every index in it is in range.
+    if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION ||
+        header->file_size != file_size || header->gbtn_max != GBTN_MAX)
+        return false;
+
+    if (header->source_size != (Uint64)source_stat->st_size ||
+        header->source_mtime_sec != (Sint64)source_stat->st_mtim.tv_sec ||
+        header->source_mtime_nsec != (Sint64)source_stat->st_mtim.tv_nsec ||
+        header->hotkey_gbtn != current_state.hotkey_gbtn ||
+        header->text_input != cache_text_input())
+        return false;
+
+    const char *strings = (const char *)cache_table(header, header->strings_offset, header->strings_size, 1);
+
+    // every string has to end inside the pool.
+    if (strings == NULL || header->strings_size == 0 || strings[header->strings_size - 1] != '\0')
+        return false;
+
+    const cache_setting *settings = CACHE_TABLE(cache_setting, settings);
+    const cache_config *configs = CACHE_TABLE(cache_config, configs);
+    const cache_char_set *char_sets = CACHE_TABLE(cache_char_set, char_sets);
+    const cache_word_set *word_sets = CACHE_TABLE(cache_word_set, word_sets);
+    const Uint32 *words = CACHE_TABLE(Uint32, words);
+
+    if (settings == NULL || configs == NULL || char_sets == NULL || word_sets == NULL || words == NULL)
+        return false;
+
+    Uint32 header_strings[] = {header->program_version, header->game_prefix};
+
+    if (!cache_strings_valid(header, header_strings, 2, true) ||
+        !cache_strings_valid(header, &header->default_control, 1, false))
+        return false;
+
+    if (strcmp(strings + header->program_version, GPTK2_VERSION) != 0 ||
+        strcmp(strings + header->game_prefix, game_prefix) != 0)
+        return false;
+
+    for (Uint32 i=0; i < header->settings_count; i++)
+    {
+        if (!cache_strings_valid(header, &settings[i].name, 1, true))
+            return false;
+    }
+
+    // the first config is always the root one.
+    if (header->configs_count == 0 || !cache_strings_valid(header, &configs[0].name, 1, true) ||
+        strcasecmp(strings + configs[0].name, "controls") != 0)
+        return false;
+
+    for (Uint32 i=0; i < header->configs_count; i++)
+    {
+        const cache_config *config = &configs[i];
+
+        if (!cache_strings_valid(header, &config->name, 1, true) ||
+            !cache_strings_valid(header, &config->charset, 2, false))
+            return false;
+
+        if (config->overlay_mode < OVL_NONE || config->overlay_mode > OVL_CLEAR ||
+            config->exclusive_mode < EXL_FALSE || config->exclusive_mode > EXL_PARENT ||
+            !cache_mouse_mode_valid(config->left_analog_as_mouse) ||
+            !cache_mouse_mode_valid(config->right_analog_as_mouse) ||
+            !cache_mouse_mode_valid(config->dpad_as_mouse) ||
+            !cache_mouse_mode_valid(config->left_analog_as_absolute_mouse) ||
+            !cache_mouse_mode_valid(config->right_analog_as_absolute_mouse))
+            return false;
+
+        for (int btn=0; btn < GBTN_MAX; btn++)
+        {
+            if (!cache_button_valid(header, &config->button[btn]))
+                return false;
+        }
+    }
+
+    for (Uint32 i=0; i < header->char_sets_count; i++)
+    {
+        if (!cache_strings_valid(header, &char_sets[i].name, 2, true))
+            return false;
+    }
+
+    for (Uint32 i=0; i < header->word_sets_count; i++)
+    {
+        if (!cache_strings_valid(header, &word_sets[i].name, 1, true) ||
+            word_sets[i].first_word > header->words_count ||
+            word_sets[i].words_len > header->words_count - word_sets[i].first_word)
+            return false;
+    }
+
+    return cache_strings_valid(header, words, header->words_count, true);
+}
+
+
+static void cache_apply(const cache_header *header)
+{   // copy a checked cache into the live configs.
+    const char *strings = (const char *)header + header->strings_offset;
+    const cache_setting *settings = CACHE_TABLE(cache_setting, settings);
+    const cache_config *configs = CACHE_TABLE(cache_config, configs);
+    const cache_char_set *char_sets = CACHE_TABLE(cache_char_set, char_sets);
+    const cache_word_set *word_sets = CACHE_TABLE(cache_word_set, word_sets);
+    const Uint32 *words = CACHE_TABLE(Uint32, words);
+
+    for (Uint32 i=0; i < header->settings_count; i++)
+        config_setting_set(strings + settings[i].name, settings[i].value);
+
+    if (header->default_control != 0)
+        strncpy(default_control_name, strings + header->default_control, MAX_CONTROL_NAME - 1);
+
+    for (Uint32 i=0; i < header->char_sets_count; i++)
+        register_char_set(strings + char_sets[i].name, strings + char_sets[i].characters);
+
+    // register_word_set() puts the newest set first, so go backwards to keep the order.
+    for (Uint32 i=header->word_sets_count; i > 0; i--)
+    {
+        const cache_word_set *set = &word_sets[i - 1];
+
+        for (Uint32 word=0; word < set->words_len; word++)
+            register_word_set(strings + set->name, strings + words[set->first_word + word]);
+    }
+
+    gptokeyb_config **loaded = (gptokeyb_config **)gptk_malloc(sizeof(gptokeyb_config *) * header->configs_count);
+
+    loaded[0] = root_config;
+
+    for (Uint32 i=1; i < header->configs_count; i++)
+        loaded[i] = config_create(strings + configs[i].name);
+
+    for (Uint32 i=0; i < header->configs_count; i++)
+    {
+        const cache_config *config = &configs[i];
+        gptokeyb_config *current = loaded[i];
+
+        current->charset = string_register(CACHE_STRING(config->charset));
+        current->wordset = string_register(CACHE_STRING(config->wordset));
+
+        current->overlay_mode   = config->overlay_mode;
+        current->exclusive_mode = config->exclusive_mode;
+
+        current->left_analog_as_mouse  = config->left_analog_as_mouse;
+        current->right_analog_as_mouse = config->right_analog_as_mouse;
+        current->dpad_as_mouse         = config->dpad_as_mouse;
+
+        current->left_analog_as_absolute_mouse  = config->left_analog_as_absolute_mouse;
+        current->right_analog_as_absolute_mouse = config->right_analog_as_absolute_mouse;
+
+        current->mouse_wheel_amount = config->mouse_wheel_amount;
+        current->map_check = false;
+
+        for (int btn=0; btn < GBTN_MAX; btn++)
+        {
+            const cache_button *button = &config->button[btn];
+
+            current->button[btn].keycode  = button->keycode;
+            current->button[btn].modifier = button->modifier;
+            current->button[btn].repeat   = (button->repeat != 0);
+            current->button[btn].action   = button->action;
+            current->button[btn].special  = button->special;
+            current->button[btn].cfg_name = string_register(CACHE_STRING(button->cfg_name));
+            current->button[btn].cfg_map  = (button->cfg_map >= 0) ? loaded[button->cfg_map] : NULL;
+        }
+    }
+
+    free(loaded);
+
+    gptk_hk_can_fix = (header->hk_can_fix != 0);
+    config_cache_finalised = true;
+}
+
+
+bool cache_load()
+{   // load the configs from a compiled cache if it is still up to date.
+    char path[PATH_MAX + sizeof(CACHE_SUFFIX)];
+    struct stat source_stat;
+    struct stat cache_stat;
+
+    if (strlen(cache_source) == 0 || stat(cache_source, &source_stat) != 0)
+        return false;
+
+    cache_path(path, sizeof(path));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &cache_stat) != 0 || cache_stat.st_size < (off_t)sizeof(cache_header))
+    {
+        close(fd);
+        return false;
+    }
+
+    void *mapped = mmap(NULL, cache_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+        return false;
+
+    bool result = cache_check((const cache_header *)mapped, (size_t)cache_stat.st_size, &source_stat);
+
+    if (result)
+    {
+        cache_apply((const cache_header *)mapped);
+        printf("Loaded compiled config '%s'\n", path);
+    }
+
+    munmap(mapped, cache_stat.st_size);
+
+    return result;
+}
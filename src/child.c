@@ -0,0 +1,325 @@
+/* Copyright (c) 2021-2024
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 2 of the License, or (at your option) any later version.
+#
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+#
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA 02110-1301 USA
+#
+* Authored by: Kris Henriksen <krishenriksen.work@gmail.com>
+#
+* AnberPorts-Keyboard-Mouse
+*
+* Part of the code is from from https://github.com/krishenriksen/AnberPorts/blob/master/AnberPorts-Keyboard-Mouse/main.c (mostly the fake keyboard)
+* Fake Xbox code from: https://github.com/Emanem/js2xbox
+*
+* Modified (badly) by: Shanti Gilbert for EmuELEC
+* Modified further by: Nikolai Wuttke for EmuELEC (Added support for SDL and the SDLGameControllerdb.txt)
+* Modified further by: Jacob Smith
+*
+* Any help improving this code would be greatly appreciated!
+*
+* DONE: Xbox360 mode: Fix triggers so that they report from 0 to 255 like real Xbox triggers
+*       Xbox360 mode: Figure out why the axis are not correctly labeled?  SDL_CONTROLLER_AXIS_RIGHTX / SDL_CONTROLLER_AXIS_RIGHTY / SDL_CONTROLLER_AXIS_TRIGGERLEFT / SDL_CONTROLLER_AXIS_TRIGGERRIGHT
+*       Keyboard mode: Add a config file option to load mappings from.
+*       add L2/R2 triggers
+*
+*/
+
+#include "gptokeyb2.h"
+
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+/* With --exec we start the program ourselves instead of being given its name.
+ * We hold a pidfd for it, so quitting signals exactly that process and we
+ * know the moment it exits. Kernels before 5.3 have no pidfd, there SIGCHLD
+ * comes in through a signalfd instead, which needs it blocked before SDL
+ * starts any threads.
+ */
+
+// how far to go closing fds in the child if there is no close_range().
+#define CHILD_MAX_FDS 4096
+
+static pid_t child_pid = -1;
+static const char *child_name = NULL;
+static int child_fd = -1;           // the pidfd, or the SIGCHLD signalfd
+static bool child_has_pidfd = false;
+static int child_status = 0;
+
+
+static int child_pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
+static int child_pidfd_send_signal(int pidfd, int sig)
+{
+#ifdef SYS_pidfd_send_signal
+    return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+#else
+    (void)pidfd;
+    (void)sig;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
+static void child_close_fds(int keep)
+{   // in the forked child, the program shouldn't get our uinput devices, controllers or sockets.
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, 3, keep - 1, 0) == 0 &&
+        syscall(SYS_close_range, keep + 1, ~0U, 0) == 0)
+        return;
+#endif
+
+    long max_fds = sysconf(_SC_OPEN_MAX);
+
+    if (max_fds < 0 || max_fds > CHILD_MAX_FDS)
+        max_fds = CHILD_MAX_FDS;
+
+    for (int fd=3; fd < max_fds; fd++)
+    {
+        if (fd != keep)
+            close(fd);
+    }
+}
+
+
+void child_prepare()
+{   // has to be called before SDL or the loop start any threads.
+    int pidfd = child_pidfd_open(getpid());
+
+    if (pidfd >= 0)
+    {
+        close(pidfd);
+        child_has_pidfd = true;
+        return;
+    }
+
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+}
+
+
+static bool child_reap()
+{   // true once the program has exited and been waited for.
+    int status;
+
+    if (child_pid <= 0 || waitpid(child_pid, &status, WNOHANG) != child_pid)
+        return false;
+
+    if (WIFSIGNALED(status))
+    {
+        child_status = 128 + WTERMSIG(status);
+        printf("'%s' was killed by signal %d\n", child_name, WTERMSIG(status));
+    }
+    else
+    {
+        child_status = WEXITSTATUS(status);
+        printf("'%s' exited with %d\n", child_name, child_status);
+    }
+
+    child_pid = -1;
+    return true;
+}
+
+
+static void child_unwatch()
+{
+    if (child_fd < 0)
+        return;
+
+    loop_unwatch_fd(child_fd);
+    close(child_fd);
+    child_fd = -1;
+}
+
+
+static void child_callback(int fd, void *data)
+{
+    (void)data;
+
+    if (!child_has_pidfd)
+    {   // SIGCHLDs merge, just empty it and try to reap.
+        struct signalfd_siginfo info;
+
+        while (read(fd, &info, sizeof(info)) == sizeof(info))
+            ;
+    }
+
+    if (!child_reap())
+        return;
+
+    child_unwatch();
+
+    // the program is gone, so are we.
+    current_state.running = false;
+}
+
+
+bool child_start(int argc, char* argv[])
+{   // fork and exec argv, which must be NULL terminated.
+    int error_pipe[2];
+
+    if (argc < 1)
+    {
+        fprintf(stderr, "--exec needs a program to run.\n");
+        return false;
+    }
+
+    // the pipe closes on a successful exec, otherwise the child writes errno down it.
+    if (pipe(error_pipe) < 0)
+    {
+        fprintf(stderr, "Unable to create the exec pipe: %s\n", strerror(errno));
+        return false;
+    }
+
+    fcntl(error_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(error_pipe[1], F_SETFD, FD_CLOEXEC);
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+
+    if (pid < 0)
+    {
+        fprintf(stderr, "Unable to start '%s': %s\n", argv[0], strerror(errno));
+        close(error_pipe[0]);
+        close(error_pipe[1]);
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        sigset_t mask;
+        int error;
+
+        // signal masks survive exec, the program gets a clean one.
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+
+        child_close_fds(error_pipe[1]);
+
+        execvp(argv[0], argv);
+
+        error = errno;
+        write(error_pipe[1], &error, sizeof(error));
+        _exit(127);
+    }
+
+    close(error_pipe[1]);
+
+    int error = 0;
+    ssize_t got;
+
+    do
+    {
+        got = read(error_pipe[0], &error, sizeof(error));
+    } while (got < 0 && errno == EINTR);
+
+    close(error_pipe[0]);
+
+    if (got == sizeof(error))
+    {
+        waitpid(pid, NULL, 0);
+        fprintf(stderr, "Unable to run '%s': %s\n", argv[0], strerror(error));
+        return false;
+    }
+
+    child_pid = pid;
+    child_name = argv[0];
+    child_status = 0;
+
+    printf("Started '%s' as %d\n", child_name, (int)child_pid);
+
+    if (child_has_pidfd)
+    {
+        child_fd = child_pidfd_open(child_pid);
+    }
+    else
+    {
+        sigset_t mask;
+
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        child_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    }
+
+    if (child_fd < 0 || !loop_watch_fd(child_fd, child_callback, NULL))
+    {
+        fprintf(stderr, "Unable to watch '%s', we won't quit when it does.\n", child_name);
+
+        if (child_fd >= 0)
+            close(child_fd);
+
+        child_fd = -1;
+        return true;
+    }
+
+    // it might have been quick.
+    child_callback(child_fd, NULL);
+
+    return true;
+}
+
+
+bool child_running()
+{
+    return (child_pid > 0);
+}
+
+
+bool child_signal(int sig)
+{
+    if (child_pid <= 0)
+        return false;
+
+    // until we reap it the pid can't be reused, so kill() is just as safe.
+    if (child_has_pidfd && child_fd >= 0 && child_pidfd_send_signal(child_fd, sig) == 0)
+        return true;
+
+    if (kill(child_pid, sig) < 0)
+    {
+        fprintf(stderr, "Unable to signal '%s': %s\n", child_name, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+
+int child_exit_status()
+{
+    return child_status;
+}
+
+
+void child_quit()
+{   // the program is left running if it hasn't exited, we just pick up its status if it has.
+    child_reap();
+    child_unwatch();
+}
@@ -65,17 +65,37 @@ gptokeyb_config *config_stack[CFG_STACK_MAX];
 gptokeyb_config *config_temp_stack[GBTN_MAX];
 
 char default_control_name[MAX_CONTROL_NAME] = "";
-int config_temp_stack_order[GBTN_MAX];
-int config_temp_stack_order_id = 0;
+
+// the held temp layers are a doubly linked list indexed by button, newest at the top.
+int config_temp_stack_prev[GBTN_MAX];
+int config_temp_stack_next[GBTN_MAX];
+int config_temp_stack_top = -1;
+int config_temp_stack_bottom = -1;
 
 int gptokeyb_config_depth = 0;
 
+/* configs are also kept in a hash table keyed on the case folded name after
+ * "controls:", root_config is handled separately.
+ */
+#define CONFIG_PREFIX "controls:"
+#define CONFIG_PREFIX_LEN 9
+#define CONFIG_HASH_SIZE 256
+
+static gptokeyb_config *config_hash[CONFIG_HASH_SIZE];
+static gptokeyb_config *last_config = NULL;
+
+// shared by every line of every config file, its buffer only grows to fit the longest value.
+static token_ctx *config_tokens = NULL;
+
 #define GPTK_HK_FIX_MAX 50
 #define GPTK_HK_FIX_MAX_LINE 1024
 char *gptk_hk_fix_text[GPTK_HK_FIX_MAX];
 int gptk_hk_fix_offset = 0;
 int gptk_hk_can_fix = true;
 
+// set when the configs came from a compiled cache, they are already finalised.
+bool config_cache_finalised = false;
+
 const char *gbtn_names[] = {
     "a",
     "b",
@@ -231,7 +251,7 @@ int special_button_max(int btn)
 
 void config_init()
 {   // Setup config structures.
-    root_config = (gptokeyb_config*)gptk_malloc(sizeof(gptokeyb_config));
+    root_config = (gptokeyb_config*)arena_alloc(load_arena, sizeof(gptokeyb_config));
 
     root_config->name = string_register("controls");
 
@@ -240,48 +260,65 @@ void config_init()
     root_config->mouse_wheel_amount = DEFAULT_MOUSE_WHEEL_AMOUNT;
 
     config_stack[0] = root_config;
+    last_config = root_config;
 
     for (int i=1; i < CFG_STACK_MAX; i++)
     {
         config_stack[i] = NULL;
     }
 
+    for (int i=0; i < CONFIG_HASH_SIZE; i++)
+    {
+        config_hash[i] = NULL;
+    }
+
     for (int btn=0; btn < GBTN_MAX; btn++)
     {
         config_temp_stack[btn] = NULL;
-        config_temp_stack_order[btn] = 0;
+        config_temp_stack_prev[btn] = -1;
+        config_temp_stack_next[btn] = -1;
     }
 
+    config_temp_stack_top = -1;
+    config_temp_stack_bottom = -1;
+
     for (int i=0; i < GPTK_HK_FIX_MAX; i++)
         gptk_hk_fix_text[i] = NULL;
+
+    config_cache_finalised = false;
+
+    default_control_name[0] = '\0';
+    gptk_hk_can_fix = true;
 }
 
 
 void config_quit()
-{   // Destroy config structures.
-    gptokeyb_config *current = root_config;
-    gptokeyb_config *next;
-
-    while (current != NULL)
+{   // Forget the config structures, the memory goes with load_arena.
+    for (int i=0; i < CFG_STACK_MAX; i++)
     {
-        next = current->next;
-
-        free(current);
-        current = next;
+        config_stack[i] = NULL;
     }
 
-    for (int i=0; i < CFG_STACK_MAX; i++)
+    for (int i=0; i < CONFIG_HASH_SIZE; i++)
     {
-        config_stack[i] = NULL;
+        config_hash[i] = NULL;
     }
 
+    root_config = NULL;
+    last_config = NULL;
+
     for (int i=0; i < gptk_hk_fix_offset; i++)
     {
-        free(gptk_hk_fix_text[i]);
         gptk_hk_fix_text[i] = NULL;
     }
 
     gptk_hk_fix_offset = 0;
+
+    if (config_tokens != NULL)
+    {
+        tokens_free(config_tokens);
+        config_tokens = NULL;
+    }
 }
 
 
@@ -299,6 +336,8 @@ void config_dump()
     printf("repeat_rate = %" PRIu64 "\n", current_state.repeat_rate);
     // printf("mouse_scale = %d\n", current_state.mouse_scale);
     printf("mouse_delay = %" PRIu64 "\n", current_state.mouse_delay);
+    if (current_state.mouse_tick > 0)
+        printf("mouse_tick = %" PRIu64 "\n", current_state.mouse_tick);
     printf("mouse_slow_scale = %d\n", current_state.mouse_slow_scale);
     printf("deadzone_mode = %s\n", deadzone_mode_str(current_state.deadzone_mode));
     printf("deadzone_scale = %d\n", current_state.deadzone_scale);
@@ -523,8 +562,45 @@ void config_overlay_clear(gptokeyb_config *current)
         current->button[btn].special  = SPC_NONE;
         current->button[btn].repeat   = false;
     }
+
+    config_summarise(current);
 }
 
+void config_summarise(gptokeyb_config *current)
+{   // fill out current->summary, needs to be called if any of the stack resolved settings change.
+    layer_summary *summary = &current->summary;
+    const struct { int mode; Uint32 flag; } mouse_modes[] = {
+        {current->dpad_as_mouse,                  LSF_DPAD_AS_MOUSE},
+        {current->left_analog_as_mouse,           LSF_LEFT_ANALOG_AS_MOUSE},
+        {current->right_analog_as_mouse,          LSF_RIGHT_ANALOG_AS_MOUSE},
+        {current->left_analog_as_absolute_mouse,  LSF_LEFT_ANALOG_AS_ABSOLUTE_MOUSE},
+        {current->right_analog_as_absolute_mouse, LSF_RIGHT_ANALOG_AS_ABSOLUTE_MOUSE},
+    };
+
+    memset((void*)summary, '\0', sizeof(layer_summary));
+
+    for (size_t i=0; i < (sizeof(mouse_modes) / sizeof(mouse_modes[0])); i++)
+    {
+        if (mouse_modes[i].mode == MOUSE_MOVEMENT_PARENT)
+            continue;
+
+        summary->decided |= mouse_modes[i].flag;
+
+        if (mouse_modes[i].mode == MOUSE_MOVEMENT_ON)
+            summary->enabled |= mouse_modes[i].flag;
+    }
+
+    summary->exclusive_mode = current->exclusive_mode;
+    summary->mouse_wheel_amount = current->mouse_wheel_amount;
+
+    if (current->charset != NULL || current->wordset != NULL)
+    {
+        summary->charset = current->charset;
+        summary->wordset = current->wordset;
+    }
+}
+
+
 void config_overlay_parent(gptokeyb_config *current)
 {
     current->overlay_mode = OVL_PARENT;
@@ -589,9 +665,45 @@ void config_overlay_named(gptokeyb_config *current, const char *name)
 }
 
 
+static const char *config_short_name(const char *name, size_t *length)
+{   /* returns the part of name after "controls:" and how much of it is used.
+     *
+     * names without the prefix get it added, and are cut to fit in MAX_CONTROL_NAME.
+     */
+    if (strcasestartswith(name, CONFIG_PREFIX))
+    {
+        name += CONFIG_PREFIX_LEN;
+        *length = strlen(name);
+    }
+    else
+    {
+        *length = strlen(name);
+
+        if (*length > (MAX_CONTROL_NAME - 2 - CONFIG_PREFIX_LEN))
+            *length = (MAX_CONTROL_NAME - 2 - CONFIG_PREFIX_LEN);
+    }
+
+    return name;
+}
+
+
+static Uint32 config_hash_name(const char *name, size_t length)
+{   // case folded FNV-1a
+    Uint32 hash = 2166136261u;
+
+    for (size_t i=0; i < length; i++)
+    {
+        hash ^= (Uint8)tolower((unsigned char)name[i]);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
 gptokeyb_config *config_find(const char *name)
 {   // Find a gptokeyb_config by name.
-    char nice_name[MAX_CONTROL_NAME];
+    size_t length;
 
     // shortcut
     if (strcasecmp("controls", name) == 0)
@@ -600,23 +712,21 @@ gptokeyb_config *config_find(const char *name)
         return root_config;
     }
 
-    if (!strcasestartswith(name, "controls:"))
-    {
-        snprintf(nice_name, MAX_CONTROL_NAME-1, "controls:%s", name);
-        name=nice_name;
-    }
+    name = config_short_name(name, &length);
 
-    gptokeyb_config *current = root_config;
+    gptokeyb_config *current = config_hash[config_hash_name(name, length) % CONFIG_HASH_SIZE];
 
     while (current != NULL)
     {
-        if (strcasecmp(current->name, name) == 0)
+        const char *current_name = current->name + CONFIG_PREFIX_LEN;
+
+        if (strlen(current_name) == length && strncasecmp(current_name, name, length) == 0)
         {
             // GPTK2_DEBUG("config_find: found %s\n", name);
             return current;
         }
 
-        current = current->next;
+        current = current->hash_next;
     }
 
     // GPTK2_DEBUG("config_find: unable to find %s\n", name);
@@ -628,17 +738,18 @@ gptokeyb_config *config_find(const char *name)
 gptokeyb_config *config_create(const char *name)
 {   // find a config, if it doesnt exist, create it.
     gptokeyb_config *result=NULL;
+    size_t length;
 
     result = config_find(name);
     if (result != NULL)
         return result;
 
-    result = (gptokeyb_config*)gptk_malloc(sizeof(gptokeyb_config));
+    result = (gptokeyb_config*)arena_alloc(load_arena, sizeof(gptokeyb_config));
 
-    if (!strcasestartswith(name, "controls:"))
+    if (!strcasestartswith(name, CONFIG_PREFIX))
     {
         char nice_name[MAX_CONTROL_NAME];
-        snprintf(nice_name, MAX_CONTROL_NAME-1, "controls:%s", name);
+        snprintf(nice_name, MAX_CONTROL_NAME-1, CONFIG_PREFIX "%s", name);
         result->name = string_register(nice_name);
     }
     else
@@ -647,158 +758,297 @@ gptokeyb_config *config_create(const char *name)
     }
 
     // add it to the linked list.
-    gptokeyb_config *last_config = root_config;
-    while (last_config->next != NULL)
-        last_config = last_config->next;
-
     last_config->next = result;
+    last_config = result;
+
+    // and the hash table.
+    name = config_short_name(result->name, &length);
+    Uint32 bucket = config_hash_name(name, length) % CONFIG_HASH_SIZE;
+
+    result->hash_next = config_hash[bucket];
+    config_hash[bucket] = result;
 
     // GPTK2_DEBUG("config_create: %s\n", result->name);
     return result;
 }
 
-void set_cfg_config(const char *name, const char *value, token_ctx *token_state)
+/*
+ * [config] options, sorted by name for config_keyword_find().
+ *
+ * Most options just clamp an integer into a field of current_state, the rest have
+ * their own handling in set_cfg_config().
+ */
+typedef enum
 {
-    // printf("%s -> %s\n", name, value);
+    CFG_KW_INT,             // int field, clamped to min..max
+    CFG_KW_TICKS,           // Uint64 field, clamped to min..max
+    CFG_KW_BOOL,            // bool field, fallback if it isnt a boolean
+    CFG_KW_DEADZONE,        // sets both deadzone_x and deadzone_y
+    CFG_KW_DEADZONE_MODE,
+    CFG_KW_CONTROLS,
+    CFG_KW_CHARSET,
+    CFG_KW_WORDSET,
+    CFG_KW_IGNORE,
+} config_keyword_kind;
 
-    if (strcasecmp(name, "repeat_delay") == 0)
-        current_state.repeat_delay = atoi_between(value, 16, 3000, SDL_DEFAULT_REPEAT_DELAY);
+typedef struct
+{
+    const char *name;
+    config_keyword_kind kind;
+    size_t offset;
+    int minimum;
+    int maximum;
+    int fallback;
+} config_keyword;
+
+#define CFG_FIELD(field) offsetof(gptokeyb_state, field)
+
+static const config_keyword config_keywords[] = {
+    {"absolute_center_x",      CFG_KW_INT,           CFG_FIELD(absolute_center_x),      1,     7680,  320},
+    {"absolute_center_y",      CFG_KW_INT,           CFG_FIELD(absolute_center_y),      1,     4320,  240},
+    {"absolute_deadzone",      CFG_KW_INT,           CFG_FIELD(absolute_deadzone),      0,     100,   3},
+    {"absolute_rotate",        CFG_KW_INT,           CFG_FIELD(absolute_rotate),        0,     271,   0},
+    {"absolute_screen_height", CFG_KW_INT,           CFG_FIELD(absolute_screen_height), 1,     4320,  1080},
+    {"absolute_screen_width",  CFG_KW_INT,           CFG_FIELD(absolute_screen_width),  1,     7680,  1920},
+    {"absolute_step",          CFG_KW_INT,           CFG_FIELD(absolute_step),          -7680, 7680,  100},
+    {"charset",                CFG_KW_CHARSET,       0,                                 0,     0,     0},
+    {"controls",               CFG_KW_CONTROLS,      0,                                 0,     0,     0},
+    {"deadzone",               CFG_KW_DEADZONE,      0,                                 500,   32768, 15000},
+    {"deadzone_delay",         CFG_KW_IGNORE,        0,                                 0,     0,     0},
+    {"deadzone_mode",          CFG_KW_DEADZONE_MODE, CFG_FIELD(deadzone_mode),          0,     0,     0},
+    {"deadzone_scale",         CFG_KW_INT,           CFG_FIELD(deadzone_scale),         1,     32768, 512},
+    {"deadzone_triggers",      CFG_KW_INT,           CFG_FIELD(deadzone_triggers),      500,   32768, 3000},
+    {"deadzone_x",             CFG_KW_INT,           CFG_FIELD(deadzone_x),             500,   32768, 1000},
+    {"deadzone_y",             CFG_KW_INT,           CFG_FIELD(deadzone_y),             500,   32768, 1000},
+    {"dpad_mouse_normalize",   CFG_KW_BOOL,          CFG_FIELD(dpad_mouse_normalize),   0,     1,     true},
+    {"mouse_delay",            CFG_KW_TICKS,         CFG_FIELD(mouse_delay),            16,    3000,  SDL_DEFAULT_REPEAT_DELAY},
+    {"mouse_scale",            CFG_KW_INT,           CFG_FIELD(deadzone_scale),         1,     32768, 512},
+    {"mouse_slow_scale",       CFG_KW_INT,           CFG_FIELD(mouse_slow_scale),       1,     100,   50},
+    {"mouse_tick",             CFG_KW_TICKS,         CFG_FIELD(mouse_tick),             4,     1000,  0},
+    {"repeat_delay",           CFG_KW_TICKS,         CFG_FIELD(repeat_delay),           16,    3000,  SDL_DEFAULT_REPEAT_DELAY},
+    {"repeat_rate",            CFG_KW_TICKS,         CFG_FIELD(repeat_rate),            16,    3000,  SDL_DEFAULT_REPEAT_INTERVAL},
+    {"wordset",                CFG_KW_WORDSET,       0,                                 0,     0,     0},
+};
 
-    else if (strcasecmp(name, "repeat_rate") == 0)
-        current_state.repeat_rate = atoi_between(value, 16, 3000, SDL_DEFAULT_REPEAT_INTERVAL);
+#undef CFG_FIELD
 
-    else if (strcasecmp(name, "mouse_slow_scale") == 0)
-        current_state.mouse_slow_scale = atoi_between(value, 1, 100, 50);
+#define CONFIG_KEYWORDS_COUNT (sizeof(config_keywords) / sizeof(config_keywords[0]))
 
-    else if (strcasecmp(name, "deadzone_mode") == 0)
-        current_state.deadzone_mode = deadzone_get_mode(value);
+// which options the config files have set, only those get saved into a compiled cache.
+static bool config_keywords_used[CONFIG_KEYWORDS_COUNT];
 
-    else if (strcasecmp(name, "deadzone_scale") == 0)
-        current_state.deadzone_scale = atoi_between(value, 1, 32768, 512);
 
-    else if (strcasecmp(name, "absolute_center_x") == 0)
-        current_state.absolute_center_x = atoi_between(value, 1, 7680, 320);
+static int keyword_compare(const void *key, const void *entry)
+{   // all the keyword tables start with the name.
+    return strcasecmp((const char *)key, *(const char * const *)entry);
+}
 
-    else if (strcasecmp(name, "absolute_center_y") == 0)
-        current_state.absolute_center_y = atoi_between(value, 1, 4320, 240);
 
-    else if (strcasecmp(name, "absolute_step") == 0)
-        current_state.absolute_step = atoi_between(value, -7680, 7680, 100);
+static const config_keyword *config_keyword_find(const char *name)
+{
+    return (const config_keyword *)bsearch(
+        name, config_keywords, CONFIG_KEYWORDS_COUNT, sizeof(config_keyword), keyword_compare);
+}
 
-    else if (strcasecmp(name, "absolute_deadzone") == 0)
-        current_state.absolute_deadzone = atoi_between(value, 0, 100, 3);
 
-    else if (strcasecmp(name, "absolute_rotate") == 0)
-        current_state.absolute_rotate = atoi_between(value, 0, 271, 0);
+static void set_cfg_char_set(const char *value, token_ctx *token_state)
+{
+    while (value != NULL && strlen(value) == 0)
+        value = tokens_next(token_state);
 
-    else if (strcasecmp(name, "absolute_screen_width") == 0)
-        current_state.absolute_screen_width = atoi_between(value, 1, 7680, 1920);
+    if (value == NULL)
+    {
+        fprintf(stderr, "charset used without any name or characters defined.\n");
+        return;
+    }
 
-    else if (strcasecmp(name, "absolute_screen_height") == 0)
-        current_state.absolute_screen_height = atoi_between(value, 1, 4320, 1080);
+    char *chars_name = strdup(value);
 
-    else if (strcasecmp(name, "mouse_scale") == 0)
-        current_state.deadzone_scale = atoi_between(value, 1, 32768, 512);
+    value = tokens_next(token_state);
 
-    else if (strcasecmp(name, "deadzone") == 0)
-        current_state.deadzone_x = current_state.deadzone_y = atoi_between(value, 500, 32768, 15000);
+    while (value != NULL && strlen(value) == 0)
+        value = tokens_next(token_state);
 
-    else if (strcasecmp(name, "deadzone_y") == 0)
-        current_state.deadzone_y = atoi_between(value, 500, 32768, 1000);
+    if (value == NULL)
+    {
+        fprintf(stderr, "charset \"%s\" specified without any characters defined.\n", chars_name);
+        free(chars_name);
+        return;
+    }
 
-    else if (strcasecmp(name, "deadzone_x") == 0)
-        current_state.deadzone_x = atoi_between(value, 500, 32768, 1000);
+    register_char_set(chars_name, value);
 
-    else if (strcasecmp(name, "deadzone_triggers") == 0)
-        current_state.deadzone_triggers = atoi_between(value, 500, 32768, 3000);
+    free(chars_name);
+}
 
-    else if (strcasecmp(name, "dpad_mouse_normalize") == 0)
-        current_state.dpad_mouse_normalize = atob_default(value, true);
 
-    else if (strcasecmp(name, "mouse_delay") == 0)
-        current_state.mouse_delay = atoi_between(value, 16, 3000, SDL_DEFAULT_REPEAT_DELAY);
+static void set_cfg_word_set(const char *value, token_ctx *token_state)
+{
+    while (value != NULL && strlen(value) == 0)
+        value = tokens_next(token_state);
 
-    else if (strcasecmp(name, "deadzone_delay") == 0)
-        ((void)0);
+    if (value == NULL)
+    {
+        fprintf(stderr, "wordset used without any name or words defined.\n");
+        return;
+    }
 
-    else if (strcasecmp(name, "controls") == 0)
-        strncpy(default_control_name, value, MAX_CONTROL_NAME - 1);
+    char *words_name = strdup(value);
 
-    else if (strcasecmp(name, "charset") == 0)
-    {
-        while (value != NULL && strlen(value) == 0)
-            value = tokens_next(token_state);
+    value = tokens_next(token_state);
 
-        if (value == NULL)
-        {
-            fprintf(stderr, "charset used without any name or characters defined.\n");
-            tokens_free(token_state);
-            return;
-        }
+    while (value != NULL && strlen(value) == 0)
+        value = tokens_next(token_state);
 
-        char *chars_name = strdup(value);
+    if (value == NULL)
+    {
+        fprintf(stderr, "wordset \"%s\" specified without any words defined.\n", words_name);
+        free(words_name);
+        return;
+    }
+
+    while (value != NULL)
+    {
+        register_word_set(words_name, value);
 
         value = tokens_next(token_state);
 
         while (value != NULL && strlen(value) == 0)
             value = tokens_next(token_state);
+    }
 
-        if (value == NULL)
-        {
-            fprintf(stderr, "charset \"%s\" specified without any characters defined.\n", chars_name);
-            free(chars_name);
-            return;
-        }
+    free(words_name);
+}
 
-        register_char_set(chars_name, value);
 
-        free(chars_name);
+void set_cfg_config(const char *name, const char *value, token_ctx *token_state)
+{
+    // printf("%s -> %s\n", name, value);
+    const config_keyword *keyword = config_keyword_find(name);
+
+    if (keyword == NULL)
+    {
+        GPTK2_DEBUG("# unknown global %s = %s\n", name, value);
         return;
     }
-    else if (strcasecmp(name, "wordset") == 0)
+
+    char *field = (char *)&current_state + keyword->offset;
+
+    config_keywords_used[keyword - config_keywords] = true;
+
+    switch (keyword->kind)
     {
-        while (value != NULL && strlen(value) == 0)
-            value = tokens_next(token_state);
+    case CFG_KW_INT:
+        *(int *)field = atoi_between(value, keyword->minimum, keyword->maximum, keyword->fallback);
+        break;
 
-        if (value == NULL)
-        {
-            fprintf(stderr, "wordset used without any name or words defined.\n");
-            return;
-        }
+    case CFG_KW_TICKS:
+        *(Uint64 *)field = atoi_between(value, keyword->minimum, keyword->maximum, keyword->fallback);
+        break;
 
-        char *words_name = strdup(value);
+    case CFG_KW_BOOL:
+        *(bool *)field = atob_default(value, keyword->fallback);
+        break;
 
-        value = tokens_next(token_state);
+    case CFG_KW_DEADZONE:
+        current_state.deadzone_x = current_state.deadzone_y = atoi_between(
+            value, keyword->minimum, keyword->maximum, keyword->fallback);
 
-        while (value != NULL && strlen(value) == 0)
-            value = tokens_next(token_state);
+        config_keywords_used[config_keyword_find("deadzone_x") - config_keywords] = true;
+        config_keywords_used[config_keyword_find("deadzone_y") - config_keywords] = true;
+        break;
 
-        if (value == NULL)
-        {
-            fprintf(stderr, "wordset \"%s\" specified without any words defined.\n", words_name);
-            free(words_name);
-            return;
-        }
+    case CFG_KW_DEADZONE_MODE:
+        *(int *)field = deadzone_get_mode(value);
+        break;
 
-        while (value != NULL)
-        {
-            register_word_set(words_name, value);
+    case CFG_KW_CONTROLS:
+        strncpy(default_control_name, value, MAX_CONTROL_NAME - 1);
+        break;
 
-            value = tokens_next(token_state);
+    case CFG_KW_CHARSET:
+        set_cfg_char_set(value, token_state);
+        break;
 
-            while (value != NULL && strlen(value) == 0)
-                value = tokens_next(token_state);
-        }
+    case CFG_KW_WORDSET:
+        set_cfg_word_set(value, token_state);
+        break;
 
-        free(words_name);
-        return;
+    case CFG_KW_IGNORE:
+        break;
     }
-#ifdef GPTK2_DEBUG_ENABLED
-    else
+}
+
+
+
+size_t config_setting_count()
+{
+    return CONFIG_KEYWORDS_COUNT;
+}
+
+
+bool config_setting_get(size_t index, const char **name, Sint64 *value)
+{   // get an option the configs have changed, only plain fields can be read back.
+    if (index >= CONFIG_KEYWORDS_COUNT || !config_keywords_used[index])
+        return false;
+
+    const config_keyword *keyword = &config_keywords[index];
+    const char *field = (const char *)&current_state + keyword->offset;
+
+    switch (keyword->kind)
     {
-        GPTK2_DEBUG("# unknown global %s = %s\n", name, value);
+    case CFG_KW_INT:
+    case CFG_KW_DEADZONE_MODE:
+        *value = *(const int *)field;
+        break;
+
+    case CFG_KW_TICKS:
+        *value = (Sint64)*(const Uint64 *)field;
+        break;
+
+    case CFG_KW_BOOL:
+        *value = *(const bool *)field;
+        break;
+
+    default:
+        return false;
+    }
+
+    *name = keyword->name;
+    return true;
+}
+
+
+bool config_setting_set(const char *name, Sint64 value)
+{   // put back an option read with config_setting_get().
+    const config_keyword *keyword = config_keyword_find(name);
+
+    if (keyword == NULL)
+        return false;
+
+    char *field = (char *)&current_state + keyword->offset;
+
+    switch (keyword->kind)
+    {
+    case CFG_KW_INT:
+    case CFG_KW_DEADZONE_MODE:
+        *(int *)field = (int)value;
+        break;
+
+    case CFG_KW_TICKS:
+        *(Uint64 *)field = (Uint64)value;
+        break;
+
+    case CFG_KW_BOOL:
+        *(bool *)field = (value != 0);
+        break;
+
+    default:
+        return false;
     }
-#endif
+
+    config_keywords_used[keyword - config_keywords] = true;
+    return true;
 }
 
 static inline void set_btn_as_mouse(int btn, gptokeyb_config *config, int mode)
@@ -823,6 +1073,103 @@ static inline void set_btn_as_absolute_mouse(int btn, gptokeyb_config *config, i
 }
 
 
+/*
+ * Binding keywords, sorted by name for button_keyword_find(). Anything that isnt in
+ * here is looked up as a key name.
+ */
+typedef enum
+{
+    BTN_KW_SPECIAL,         // value is the SPC_* action
+    BTN_KW_STATE,           // value is the ACT_STATE_* action, takes a state name
+    BTN_KW_SET_STATE,
+    BTN_KW_POP_STATE,
+    BTN_KW_MODIFIER,        // value is the MOD_* bit
+    BTN_KW_REPEAT,
+    BTN_KW_PARENT,
+    BTN_KW_CLEAR,
+    BTN_KW_MOUSE_MOVEMENT,
+    BTN_KW_MOUSE_ABSOLUTE,
+    BTN_KW_ARROW_KEYS,
+} button_keyword_kind;
+
+typedef struct
+{
+    const char *name;
+    button_keyword_kind kind;
+    int value;
+    bool not_first;         // "alt" on its own is the alt key, "x alt" adds the modifier.
+} button_keyword;
+
+static const button_keyword button_keywords[] = {
+    {"add_alt",        BTN_KW_MODIFIER,       MOD_ALT,          false},
+    {"add_ctrl",       BTN_KW_MODIFIER,       MOD_CTRL,         false},
+    {"add_letter",     BTN_KW_SPECIAL,        SPC_ADD_LETTER,   false},
+    {"add_shift",      BTN_KW_MODIFIER,       MOD_SHIFT,        false},
+    {"alt",            BTN_KW_MODIFIER,       MOD_ALT,          true},
+    {"arrow_keys",     BTN_KW_ARROW_KEYS,     0,                false},
+    {"cancel_text",    BTN_KW_SPECIAL,        SPC_CANCEL_INPUT, false},
+    {"clear",          BTN_KW_CLEAR,          0,                false},
+    {"ctrl",           BTN_KW_MODIFIER,       MOD_CTRL,         true},
+    {"finish_text",    BTN_KW_SPECIAL,        SPC_ACCEPT_INPUT, false},
+    {"hold_state",     BTN_KW_STATE,          ACT_STATE_HOLD,   false},
+    {"lower_case",     BTN_KW_SPECIAL,        SPC_LOWER_CASE,   false},
+    {"mouse_absolute", BTN_KW_MOUSE_ABSOLUTE, 0,                false},
+    {"mouse_movement", BTN_KW_MOUSE_MOVEMENT, 0,                false},
+    {"mouse_slow",     BTN_KW_SPECIAL,        SPC_MOUSE_SLOW,   false},
+    {"next_letter",    BTN_KW_SPECIAL,        SPC_NEXT_LETTER,  false},
+    {"next_word",      BTN_KW_SPECIAL,        SPC_NEXT_WORD,    false},
+    {"parent",         BTN_KW_PARENT,         0,                false},
+    {"pop_state",      BTN_KW_POP_STATE,      0,                false},
+    {"prev_letter",    BTN_KW_SPECIAL,        SPC_PREV_LETTER,  false},
+    {"prev_word",      BTN_KW_SPECIAL,        SPC_PREV_WORD,    false},
+    {"push_state",     BTN_KW_STATE,          ACT_STATE_PUSH,   false},
+    {"remove_letter",  BTN_KW_SPECIAL,        SPC_REM_LETTER,   false},
+    {"repeat",         BTN_KW_REPEAT,         0,                false},
+    {"set_state",      BTN_KW_SET_STATE,      0,                false},
+    {"shift",          BTN_KW_MODIFIER,       MOD_SHIFT,        true},
+    {"toggle_case",    BTN_KW_SPECIAL,        SPC_TOGGLE_CASE,  false},
+    {"upper_case",     BTN_KW_SPECIAL,        SPC_UPPER_CASE,   false},
+};
+
+#define BUTTON_KEYWORDS_COUNT (sizeof(button_keywords) / sizeof(button_keywords[0]))
+
+
+static const button_keyword *button_keyword_find(const char *name, bool first_run)
+{
+    const button_keyword *keyword = (const button_keyword *)bsearch(
+        name, button_keywords, BUTTON_KEYWORDS_COUNT, sizeof(button_keyword), keyword_compare);
+
+    if (keyword != NULL && keyword->not_first && first_run)
+        return NULL;
+
+    return keyword;
+}
+
+
+static void set_btn_key(gptokeyb_config *config, int btn, const keyboard_values *key)
+{
+    set_btn_as_mouse(btn, config, MOUSE_MOVEMENT_OFF);
+
+    if (btn >= GBTN_MAX)
+    {
+        for (int sbtn=special_button_min(btn); sbtn < special_button_max(btn); sbtn++)
+        {
+            config->button[sbtn].keycode = key->keycode;
+            config->button[sbtn].action  = ACT_NONE;
+            config->button[sbtn].special = SPC_NONE;
+        }
+    }
+    else
+    {
+        config->button[btn].keycode  = key->keycode;
+        config->button[btn].action   = ACT_NONE;
+        config->button[btn].special  = SPC_NONE;
+        // CEBION SAID NO
+        // config->button[btn].modifier |= key->modifier;
+    }
+}
+
+
 void set_btn_config(gptokeyb_config *config, int btn, const char *name, const char *value, token_ctx *token_state)
 {   // this parses a keybinding
     /*
@@ -846,153 +1193,50 @@ void set_btn_config(gptokeyb_config *config, int btn, const char *name, const ch
             continue;
         }
 
-        if (strcasecmp(token, "mouse_slow") == 0)
-        {
-            // Can't set mouse_slow to the special buttons
-            if (btn >= GBTN_MAX)
-            {
-                fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                return;
-            }
-
-            set_btn_as_mouse(btn, config, MOUSE_MOVEMENT_OFF);
-            config->button[btn].action  = ACT_SPECIAL;
-            config->button[btn].special = SPC_MOUSE_SLOW;
-        }
-        else if (strcasecmp(token, "prev_letter") == 0)
-        {
-            // Can't set mouse_slow to the special buttons
-            if (btn >= GBTN_MAX)
-            {
-                fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                return;
-            }
-
-            config->button[btn].action  = ACT_SPECIAL;
-            config->button[btn].special = SPC_PREV_LETTER;
-        }
-        else if (strcasecmp(token, "next_letter") == 0)
-        {
-            // Can't set mouse_slow to the special buttons
-            if (btn >= GBTN_MAX)
-            {
-                fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                return;
-            }
-
-            config->button[btn].action  = ACT_SPECIAL;
-            config->button[btn].special = SPC_NEXT_LETTER;
-        }
-        else if (strcasecmp(token, "add_letter") == 0)
-        {
-            // Can't set mouse_slow to the special buttons
-            if (btn >= GBTN_MAX)
-            {
-                fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                return;
-            }
+        const button_keyword *keyword = button_keyword_find(token, first_run);
 
-            config->button[btn].action  = ACT_SPECIAL;
-            config->button[btn].special = SPC_ADD_LETTER;
-        }
-        else if (strcasecmp(token, "remove_letter") == 0)
+        if (keyword == NULL)
         {
-            // Can't set mouse_slow to the special buttons
-            if (btn >= GBTN_MAX)
-            {
-                fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                return;
-            }
+            const keyboard_values *key = find_keyboard(token);
 
-            config->button[btn].action  = ACT_SPECIAL;
-            config->button[btn].special = SPC_REM_LETTER;
-        }
-        else if (strcasecmp(token, "prev_word") == 0)
-        {
-            // Can't set mouse_slow to the special buttons
-            if (btn >= GBTN_MAX)
+            if (key != NULL)
             {
-                fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                return;
+                set_btn_key(config, btn, key);
             }
-
-            config->button[btn].action  = ACT_SPECIAL;
-            config->button[btn].special = SPC_PREV_WORD;
-        }
-        else if (strcasecmp(token, "next_word") == 0)
-        {
-            // Can't set mouse_slow to the special buttons
-            if (btn >= GBTN_MAX)
+            else if (strcmp(token, "\\\"") == 0)
             {
-                fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                return;
+                // GPTK2_DEBUG("# empty key %s, %s = %s\n", token, name, value);
+                // DO NOTHING
             }
-
-            config->button[btn].action  = ACT_SPECIAL;
-            config->button[btn].special = SPC_NEXT_WORD;
-        }
-        else if (strcasecmp(token, "lower_case") == 0)
-        {
-            // Can't set mouse_slow to the special buttons
-            if (btn >= GBTN_MAX)
+            else
             {
-                fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                return;
+                fprintf(stderr, "warning: unknown key \"%s\" in binding: %s = \"%s\"\n", token, name, value);
+                // GPTK2_DEBUG("# unknown key \"%s\", %s = \"%s\"\n", token, name, value);
             }
 
-            config->button[btn].action  = ACT_SPECIAL;
-            config->button[btn].special = SPC_LOWER_CASE;
+            token = tokens_next(token_state);
+            first_run = false;
+            continue;
         }
-        else if (strcasecmp(token, "upper_case") == 0)
-        {
-            // Can't set mouse_slow to the special buttons
-            if (btn >= GBTN_MAX)
-            {
-                fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                return;
-            }
 
-            config->button[btn].action  = ACT_SPECIAL;
-            config->button[btn].special = SPC_UPPER_CASE;
-        }
-        else if (strcasecmp(token, "toggle_case") == 0)
+        switch (keyword->kind)
         {
-            // Can't set mouse_slow to the special buttons
+        case BTN_KW_SPECIAL:
+            // Can't set specials to the special buttons
             if (btn >= GBTN_MAX)
             {
                 fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
                 return;
             }
 
-            config->button[btn].action  = ACT_SPECIAL;
-            config->button[btn].special = SPC_TOGGLE_CASE;
-        }
-        else if (strcasecmp(token, "finish_text") == 0)
-        {
-            // Can't set mouse_slow to the special buttons
-            if (btn >= GBTN_MAX)
-            {
-                fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                return;
-            }
+            if (keyword->value == SPC_MOUSE_SLOW)
+                set_btn_as_mouse(btn, config, MOUSE_MOVEMENT_OFF);
 
             config->button[btn].action  = ACT_SPECIAL;
-            config->button[btn].special = SPC_ACCEPT_INPUT;
-        }
-        else if (strcasecmp(token, "cancel_text") == 0)
-        {
-            // Can't set mouse_slow to the special buttons
-            if (btn >= GBTN_MAX)
-            {
-                fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                return;
-            }
+            config->button[btn].special = keyword->value;
+            break;
 
-            config->button[btn].action  = ACT_SPECIAL;
-            config->button[btn].special = SPC_CANCEL_INPUT;
-        }
-        else if (strcasecmp(token, "hold_state") == 0)
-        {
+        case BTN_KW_STATE:
             if (btn >= GBTN_MAX)
             {
                 fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
@@ -1006,31 +1250,12 @@ void set_btn_config(gptokeyb_config *config, int btn, const char *name, const ch
             }
 
             set_btn_as_mouse(btn, config, MOUSE_MOVEMENT_OFF);
-            config->button[btn].action = ACT_STATE_HOLD;
+            config->button[btn].action = keyword->value;
             config->button[btn].cfg_name = string_register(token);
             config->map_check = true;
-        }
-        else if (strcasecmp(token, "push_state") == 0)
-        {
-            if (btn >= GBTN_MAX)
-            {
-                fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                return;
-            }
-
-            token = tokens_next(token_state);
-            if (token == NULL)
-            {
-                return;
-            }
+            break;
 
-            set_btn_as_mouse(btn, config, MOUSE_MOVEMENT_OFF);
-            config->button[btn].action = ACT_STATE_PUSH;
-            config->button[btn].cfg_name = string_register(token);
-            config->map_check = true;
-        }
-        else if (strcasecmp(token, "set_state") == 0)
-        {
+        case BTN_KW_SET_STATE:
             token = tokens_next(token_state);
             if (token == NULL)
             {
@@ -1048,57 +1273,32 @@ void set_btn_config(gptokeyb_config *config, int btn, const char *name, const ch
             config->button[btn].action = ACT_STATE_SET;
             config->button[btn].cfg_name = string_register(token);
             config->map_check = true;
-        }
-        else if (strcasecmp(token, "pop_state") == 0)
-        {
+            break;
+
+        case BTN_KW_POP_STATE:
             if (btn >= GBTN_MAX)
             {
                 fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                tokens_free(token_state);
                 return;
             }
 
             set_btn_as_mouse(btn, config, MOUSE_MOVEMENT_OFF);
             config->button[btn].action = ACT_STATE_POP;
-        }
-        else if ((strcasecmp(token, "add_alt") == 0) || (!first_run && (strcasecmp(token, "alt") == 0)))
-        {
-            if (btn >= GBTN_MAX)
-            {
-                for (int sbtn=special_button_min(btn); sbtn < special_button_max(btn); sbtn++)
-                    config->button[sbtn].modifier |= MOD_ALT;
-            }
-            else
-            {
-                config->button[btn].modifier |= MOD_ALT;
-            }
-        }
-        else if ((strcasecmp(token, "add_ctrl") == 0) || (!first_run && (strcasecmp(token, "ctrl") == 0)))
-        {
-            if (btn >= GBTN_MAX)
-            {
-                for (int sbtn=special_button_min(btn); sbtn < special_button_max(btn); sbtn++)
-                    config->button[sbtn].modifier |= MOD_CTRL;
-            }
-            else
-            {
-                config->button[btn].modifier |= MOD_CTRL;
-            }
-        }
-        else if ((strcasecmp(token, "add_shift") == 0) || (!first_run && (strcasecmp(token, "shift") == 0)))
-        {
+            break;
+
+        case BTN_KW_MODIFIER:
             if (btn >= GBTN_MAX)
             {
                 for (int sbtn=special_button_min(btn); sbtn < special_button_max(btn); sbtn++)
-                    config->button[sbtn].modifier |= MOD_SHIFT;
+                    config->button[sbtn].modifier |= keyword->value;
             }
             else
             {
-                config->button[btn].modifier |= MOD_SHIFT;
+                config->button[btn].modifier |= keyword->value;
             }
-        }
-        else if (strcasecmp(token, "repeat") == 0)
-        {
+            break;
+
+        case BTN_KW_REPEAT:
             if (btn >= GBTN_MAX)
             {
                 for (int sbtn=special_button_min(btn); sbtn < special_button_max(btn); sbtn++)
@@ -1110,143 +1310,64 @@ void set_btn_config(gptokeyb_config *config, int btn, const char *name, const ch
             {
                 config->button[btn].repeat = true;
             }
-        }
-        else if (strcasecmp(token, "parent") == 0)
-        {
-            set_btn_as_mouse(btn, config, MOUSE_MOVEMENT_PARENT);
-            if (btn >= GBTN_MAX)
-            {
-                for (int sbtn=special_button_min(btn); sbtn < special_button_max(btn); sbtn++)
-                {
-                    config->button[sbtn].keycode  = 0;
-                    config->button[sbtn].modifier = 0;
-                    config->button[sbtn].action   = ACT_PARENT;
-                    config->button[sbtn].special  = SPC_NONE;
-                }
-            }
-            else
-            {
-                config->button[btn].keycode  = 0;
-                config->button[btn].modifier = 0;
-                config->button[btn].action   = ACT_PARENT;
-                config->button[btn].special  = SPC_NONE;
-            }
-        }
-        else if (strcasecmp(token, "clear") == 0)
-        {
-            set_btn_as_mouse(btn, config, MOUSE_MOVEMENT_OFF);
-            if (btn >= GBTN_MAX)
-            {
-                for (int sbtn=special_button_min(btn); sbtn < special_button_max(btn); sbtn++)
-                {
-                    config->button[sbtn].keycode  = 0;
-                    config->button[sbtn].modifier = 0;
-                    config->button[sbtn].action   = ACT_NONE;
-                    config->button[sbtn].special  = SPC_NONE;
-                }
-            }
-            else
-            {
-                config->button[btn].keycode  = 0;
-                config->button[btn].modifier = 0;
-                config->button[btn].action   = ACT_NONE;
-                config->button[btn].special  = SPC_NONE;
-            }
-        }
-        else
-        {
-            const keyboard_values *key = find_keyboard(token);
+            break;
 
-            if (key != NULL)
+        case BTN_KW_PARENT:
+        case BTN_KW_CLEAR:
             {
-                set_btn_as_mouse(btn, config, MOUSE_MOVEMENT_OFF);
+                int action = (keyword->kind == BTN_KW_PARENT) ? ACT_PARENT : ACT_NONE;
 
+                set_btn_as_mouse(btn, config, (keyword->kind == BTN_KW_PARENT) ? MOUSE_MOVEMENT_PARENT : MOUSE_MOVEMENT_OFF);
                 if (btn >= GBTN_MAX)
                 {
                     for (int sbtn=special_button_min(btn); sbtn < special_button_max(btn); sbtn++)
                     {
-                        config->button[sbtn].keycode = key->keycode;
-                        config->button[sbtn].action  = ACT_NONE;
-                        config->button[sbtn].special = SPC_NONE;
+                        config->button[sbtn].keycode  = 0;
+                        config->button[sbtn].modifier = 0;
+                        config->button[sbtn].action   = action;
+                        config->button[sbtn].special  = SPC_NONE;
                     }
                 }
                 else
                 {
-                    config->button[btn].keycode  = key->keycode;
-                    config->button[btn].action   = ACT_NONE;
+                    config->button[btn].keycode  = 0;
+                    config->button[btn].modifier = 0;
+                    config->button[btn].action   = action;
                     config->button[btn].special  = SPC_NONE;
-                    // CEBION SAID NO
-                    // config->button[btn].modifier |= key->modifier;
                 }
             }
-            else if (strcasecmp(token, "mouse_movement") == 0)
-            {
-                if (btn >= GBTN_MAX)
-                {
-                    set_btn_as_mouse(btn, config, MOUSE_MOVEMENT_ON);
+            break;
 
-                    for (int sbtn=special_button_min(btn), i=0; sbtn < special_button_max(btn); sbtn++, i++)
-                    {
-                        config->button[sbtn].keycode = 0;
-                        config->button[sbtn].action  = ACT_NONE;
-                        config->button[sbtn].special = SPC_NONE;
-                    }
-                }
-                else
-                {
-                    fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                    return;
-                }
+        case BTN_KW_MOUSE_MOVEMENT:
+        case BTN_KW_MOUSE_ABSOLUTE:
+        case BTN_KW_ARROW_KEYS:
+            // only the dpad and analog sticks
+            if (btn < GBTN_MAX)
+            {
+                fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
+                return;
             }
-            else if (strcasecmp(token, "mouse_absolute") == 0)
+
             {
-                if (btn >= GBTN_MAX)
-                {
+                short keycodes[] = {KEY_UP, KEY_DOWN, KEY_LEFT, KEY_RIGHT};
+
+                if (keyword->kind == BTN_KW_MOUSE_MOVEMENT)
+                    set_btn_as_mouse(btn, config, MOUSE_MOVEMENT_ON);
+
+                else if (keyword->kind == BTN_KW_MOUSE_ABSOLUTE)
                     set_btn_as_absolute_mouse(btn, config, MOUSE_MOVEMENT_ON);
 
-                    for (int sbtn=special_button_min(btn), i=0; sbtn < special_button_max(btn); sbtn++, i++)
-                    {
-                        config->button[sbtn].keycode = 0;
-                        config->button[sbtn].action  = ACT_NONE;
-                        config->button[sbtn].special = SPC_NONE;
-                    }
-                }
                 else
-                {
-                    fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                    return;
-                }
-            }
-            else if (strcasecmp(token, "arrow_keys") == 0)
-            {
-                if (btn >= GBTN_MAX)
-                {
                     set_btn_as_mouse(btn, config, MOUSE_MOVEMENT_OFF);
 
-                    short keycodes[] = {KEY_UP, KEY_DOWN, KEY_LEFT, KEY_RIGHT};
-                    for (int sbtn=special_button_min(btn), i=0; sbtn < special_button_max(btn); sbtn++, i++)
-                    {
-                        config->button[sbtn].keycode = keycodes[i];
-                        config->button[sbtn].action  = ACT_NONE;
-                        config->button[sbtn].special = SPC_NONE;
-                    }
-                }
-                else
+                for (int sbtn=special_button_min(btn), i=0; sbtn < special_button_max(btn); sbtn++, i++)
                 {
-                    fprintf(stderr, "error: unable to set %s to %s\n", token, gbtn_names[btn]);
-                    return;
+                    config->button[sbtn].keycode = (keyword->kind == BTN_KW_ARROW_KEYS) ? keycodes[i] : 0;
+                    config->button[sbtn].action  = ACT_NONE;
+                    config->button[sbtn].special = SPC_NONE;
                 }
             }
-            else if (strcmp(token, "\\\"") == 0)
-            {
-                // GPTK2_DEBUG("# empty key %s, %s = %s\n", token, name, value);
-                // DO NOTHING
-            }
-            else
-            {
-                fprintf(stderr, "warning: unknown key \"%s\" in binding: %s = \"%s\"\n", token, name, value);
-                // GPTK2_DEBUG("# unknown key \"%s\", %s = \"%s\"\n", token, name, value);
-            }
+            break;
         }
 
         token = tokens_next(token_state);
@@ -1260,13 +1381,13 @@ static int config_ini_handler(
 {
     config_parser* config = (config_parser*)user;
 
-    char *temp_buffer = tabulate_text(value);
+    if (config_tokens == NULL)
+        config_tokens = tokens_create(NULL, '\t');
 
-    if (temp_buffer == NULL)
-        return 0;
+    token_ctx *token_state = config_tokens;
 
-    token_ctx *token_state = tokens_create(temp_buffer, '\t');
-    free(temp_buffer);
+    if (!tokens_tabulate(token_state, value))
+        return 0;
 
     const char *token = tokens_next(token_state);
 
@@ -1293,7 +1414,6 @@ static int config_ini_handler(
             else
             {
                 // GPTK2_DEBUG("IGNORE GAME OVERRIDE \"%s\": %s = %s\n", section, name, value);
-                tokens_free(token_state);
                 return 1;
             }
         }
@@ -1404,7 +1524,7 @@ static int config_ini_handler(
         }
         else if (strcaseendswith(name, "_hk"))
         {
-            char *temp = (char*)gptk_malloc(GPTK_HK_FIX_MAX_LINE);
+            char *temp = (char*)arena_alloc(load_arena, GPTK_HK_FIX_MAX_LINE);
 
             snprintf(temp, GPTK_HK_FIX_MAX_LINE, "%s=%s", name, value);
 
@@ -1509,7 +1629,6 @@ static int config_ini_handler(
         GPTK2_DEBUG("?: %s: %s\n", name, value);
     }
 
-    tokens_free(token_state);
     return 1;
 }
 
@@ -1526,6 +1645,8 @@ int config_load(const char *file_name, bool config_only)
 
     if (config_only)
         config.state = CFG_CONFIG;
+    else
+        config_cache_finalised = false;
 
     if (ini_parse(file_name, config_ini_handler, &config) < 0)
     {
@@ -1550,7 +1671,7 @@ void config_finalise()
     config.current_config = root_config;
     config.config_only = false;
 
-    if (gptk_hk_can_fix)
+    if (gptk_hk_can_fix && !config_cache_finalised)
     {   // if we have only seen a gptk file we can convert <key>_hk automatically.
         current->overlay_mode = OVL_CLEAR;
 
@@ -1660,6 +1781,8 @@ void config_finalise()
             current->map_check = false;
         }
 
+        config_summarise(current);
+
         current = current->next;
     }
 }
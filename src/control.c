@@ -0,0 +1,339 @@
+/* Copyright (c) 2021-2024
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 2 of the License, or (at your option) any later version.
+#
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+#
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA 02110-1301 USA
+#
+* Authored by: Kris Henriksen <krishenriksen.work@gmail.com>
+#
+* AnberPorts-Keyboard-Mouse
+*
+* Part of the code is from from https://github.com/krishenriksen/AnberPorts/blob/master/AnberPorts-Keyboard-Mouse/main.c (mostly the fake keyboard)
+* Fake Xbox code from: https://github.com/Emanem/js2xbox
+*
+* Modified (badly) by: Shanti Gilbert for EmuELEC
+* Modified further by: Nikolai Wuttke for EmuELEC (Added support for SDL and the SDLGameControllerdb.txt)
+* Modified further by: Jacob Smith
+*
+* Any help improving this code would be greatly appreciated!
+*
+* DONE: Xbox360 mode: Fix triggers so that they report from 0 to 255 like real Xbox triggers
+*       Xbox360 mode: Figure out why the axis are not correctly labeled?  SDL_CONTROLLER_AXIS_RIGHTX / SDL_CONTROLLER_AXIS_RIGHTY / SDL_CONTROLLER_AXIS_TRIGGERLEFT / SDL_CONTROLLER_AXIS_TRIGGERRIGHT
+*       Keyboard mode: Add a config file option to load mappings from.
+*       add L2/R2 triggers
+*
+*/
+
+#include "gptokeyb2.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#define CONTROL_MAX_COMMAND 256
+#define CONTROL_MAX_REPLY   1024
+
+// commands handled per wakeup, so a flood of them can't hold up the input.
+#define CONTROL_MAX_BATCH 16
+
+// how long --send waits for the reply, in milliseconds.
+#define CONTROL_TIMEOUT 1000
+
+/* --control opens a unix datagram socket next to the daemon one. Every
+ * datagram is one command, and the sender gets one datagram back if it has
+ * an address to reply to:
+ *
+ *   push <state>     push a state, like push_state
+ *   pop              pop the top state
+ *   set <state>      replace the top state, like set_state
+ *   charset <name>   start text input with a char set
+ *   wordset <name>   start text input with a word set
+ *   stack            list the state stack, bottom first
+ *
+ * Replies start with "ok" or "error". The commands run on the main loop like
+ * any other input, so nothing is ever waited on.
+ */
+
+static int control_fd = -1;
+static char control_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+
+static void control_command(char *command, char *reply, size_t reply_size)
+{
+    // one line, surrounding whitespace ignored.
+    size_t length = strlen(command);
+
+    while (length > 0 && isspace((unsigned char)command[length - 1]))
+        command[--length] = '\0';
+
+    command += strspn(command, " \t");
+
+    char *argument = command + strcspn(command, " \t");
+
+    if (*argument != '\0')
+    {
+        *argument++ = '\0';
+        argument += strspn(argument, " \t");
+    }
+
+    if (strcasecmp(command, "push") == 0 || strcasecmp(command, "set") == 0)
+    {
+        gptokeyb_config *config = config_find(argument);
+
+        if (config == NULL)
+        {
+            snprintf(reply, reply_size, "error unknown state '%s'", argument);
+            return;
+        }
+
+        if (strcasecmp(command, "push") == 0)
+        {
+            if (gptokeyb_config_depth >= (CFG_STACK_MAX - 1))
+            {
+                snprintf(reply, reply_size, "error maximum state depth reached");
+                return;
+            }
+
+            push_state(config);
+        }
+        else
+        {
+            set_state(config);
+        }
+    }
+
+    else if (strcasecmp(command, "pop") == 0)
+    {
+        if (gptokeyb_config_depth == 0)
+        {
+            snprintf(reply, reply_size, "error nothing to pop");
+            return;
+        }
+
+        pop_state();
+    }
+
+    else if (strcasecmp(command, "charset") == 0)
+    {
+        if (find_char_set(argument) == NULL)
+        {
+            snprintf(reply, reply_size, "error unknown charset '%s'", argument);
+            return;
+        }
+
+        input_load_char_set(argument);
+        status_update();
+    }
+
+    else if (strcasecmp(command, "wordset") == 0)
+    {
+        if (find_word_set(argument) == NULL)
+        {
+            snprintf(reply, reply_size, "error unknown wordset '%s'", argument);
+            return;
+        }
+
+        input_load_word_set(argument);
+        status_update();
+    }
+
+    else if (strcasecmp(command, "stack") == 0)
+    {
+        size_t offset = (size_t)snprintf(reply, reply_size, "ok");
+
+        for (int i=0; i <= gptokeyb_config_depth && offset < reply_size; i++)
+            offset += (size_t)snprintf(reply + offset, reply_size - offset, " %s", config_stack[i]->name);
+
+        return;
+    }
+
+    else
+    {
+        snprintf(reply, reply_size, "error unknown command '%s'", command);
+        return;
+    }
+
+    snprintf(reply, reply_size, "ok");
+}
+
+
+static void control_callback(int fd, void *data)
+{
+    char command[CONTROL_MAX_COMMAND + 1];
+    char reply[CONTROL_MAX_REPLY];
+    struct sockaddr_un sender;
+    (void)data;
+
+    for (int i=0; i < CONTROL_MAX_BATCH; i++)
+    {
+        socklen_t sender_len = sizeof(sender);
+
+        // MSG_TRUNC gives the real size, so long commands aren't run cut short.
+        ssize_t len = recvfrom(fd, command, CONTROL_MAX_COMMAND, MSG_TRUNC, (struct sockaddr *)&sender, &sender_len);
+
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            // EAGAIN, that was all of them.
+            break;
+        }
+
+        if (len > CONTROL_MAX_COMMAND)
+        {
+            snprintf(reply, sizeof(reply), "error command too long");
+        }
+        else
+        {
+            command[len] = '\0';
+            control_command(command, reply, sizeof(reply));
+        }
+
+        // unbound senders don't get an answer.
+        if (sender_len > sizeof(sa_family_t))
+            sendto(fd, reply, strlen(reply), MSG_DONTWAIT, (struct sockaddr *)&sender, sender_len);
+    }
+}
+
+
+int control_send(const char *command)
+{   // for --send, returns 0 if the command worked.
+    struct sockaddr_un address;
+    struct sockaddr_un local;
+    struct timeval timeout = { CONTROL_TIMEOUT / 1000, (CONTROL_TIMEOUT % 1000) * 1000 };
+    char reply[CONTROL_MAX_REPLY];
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (!runtime_path(address.sun_path, sizeof(address.sun_path), ".ctl"))
+    {
+        fprintf(stderr, "The control socket path is too long.\n");
+        return 1;
+    }
+
+    if (!runtime_path_ours(address.sun_path))
+        return 1;
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Unable to create a socket: %s\n", strerror(errno));
+        return 1;
+    }
+
+    // an unnamed address is enough for the reply to find us.
+    memset(&local, 0, sizeof(local));
+    local.sun_family = AF_UNIX;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // connected, so only a reply from that socket is taken.
+    if (bind(fd, (struct sockaddr *)&local, sizeof(sa_family_t)) < 0 ||
+        connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        send(fd, command, strlen(command), 0) < 0)
+    {
+        fprintf(stderr, "Unable to send to '%s': %s\n", address.sun_path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    ssize_t len = recv(fd, reply, sizeof(reply) - 1, 0);
+
+    close(fd);
+
+    if (len < 0)
+    {
+        fprintf(stderr, "No reply from '%s'.\n", address.sun_path);
+        return 1;
+    }
+
+    reply[len] = '\0';
+    printf("%s\n", reply);
+
+    return strstartswith(reply, "ok") ? 0 : 1;
+}
+
+
+bool control_init()
+{
+    struct sockaddr_un address;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (!runtime_path(address.sun_path, sizeof(address.sun_path), ".ctl"))
+    {
+        fprintf(stderr, "The control socket path is too long.\n");
+        return false;
+    }
+
+    control_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (control_fd < 0)
+    {
+        fprintf(stderr, "Unable to create the control socket: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (!runtime_path_ours(address.sun_path))
+    {
+        close(control_fd);
+        control_fd = -1;
+        return false;
+    }
+
+    // datagram sockets can't tell if anyone else is using it, the last one started wins.
+    unlink(address.sun_path);
+
+    // datagrams don't say who sent them, so nobody else may ever be able to write to it.
+    mode_t old_mask = umask(S_IRWXG | S_IRWXO);
+    int result = bind(control_fd, (struct sockaddr *)&address, sizeof(address));
+    umask(old_mask);
+
+    if (result < 0 ||
+        chmod(address.sun_path, S_IRUSR | S_IWUSR) < 0)
+    {
+        fprintf(stderr, "Unable to bind '%s': %s\n", address.sun_path, strerror(errno));
+        close(control_fd);
+        control_fd = -1;
+        return false;
+    }
+
+    strncpy(control_path, address.sun_path, sizeof(control_path) - 1);
+
+    if (!loop_watch_fd(control_fd, control_callback, NULL))
+    {
+        control_quit();
+        return false;
+    }
+
+    printf("Control socket on '%s'\n", control_path);
+
+    return true;
+}
+
+
+void control_quit()
+{
+    if (control_fd < 0)
+        return;
+
+    loop_unwatch_fd(control_fd);
+    close(control_fd);
+    control_fd = -1;
+
+    unlink(control_path);
+}
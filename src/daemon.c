@@ -0,0 +1,598 @@
+/* Copyright (c) 2021-2024
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 2 of the License, or (at your option) any later version.
+#
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+#
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA 02110-1301 USA
+#
+* Authored by: Kris Henriksen <krishenriksen.work@gmail.com>
+#
+* AnberPorts-Keyboard-Mouse
+*
+* Part of the code is from from https://github.com/krishenriksen/AnberPorts/blob/master/AnberPorts-Keyboard-Mouse/main.c (mostly the fake keyboard)
+* Fake Xbox code from: https://github.com/Emanem/js2xbox
+*
+* Modified (badly) by: Shanti Gilbert for EmuELEC
+* Modified further by: Nikolai Wuttke for EmuELEC (Added support for SDL and the SDLGameControllerdb.txt)
+* Modified further by: Jacob Smith
+*
+* Any help improving this code would be greatly appreciated!
+*
+* DONE: Xbox360 mode: Fix triggers so that they report from 0 to 255 like real Xbox triggers
+*       Xbox360 mode: Figure out why the axis are not correctly labeled?  SDL_CONTROLLER_AXIS_RIGHTX / SDL_CONTROLLER_AXIS_RIGHTY / SDL_CONTROLLER_AXIS_TRIGGERLEFT / SDL_CONTROLLER_AXIS_TRIGGERRIGHT
+*       Keyboard mode: Add a config file option to load mappings from.
+*       add L2/R2 triggers
+*
+*/
+
+#define _GNU_SOURCE     // struct ucred
+
+#include "gptokeyb2.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define DAEMON_MAGIC   0x44545047  // "GPTD"
+#define DAEMON_VERSION 1
+
+// largest request we will take, arguments and environment together.
+#define DAEMON_MAX_REQUEST 65536
+
+// clients still sending their request, past this the slowest is dropped.
+#define DAEMON_MAX_CLIENTS 4
+
+/* With --daemon one long running process owns the fake devices, any later
+ * invocation sends its arguments over a unix socket and returns straight
+ * away. The daemon throws away the old configs and loads the new ones, the
+ * devices themselves never change so nothing has to find them again.
+ */
+
+typedef struct
+{
+    Uint32 magic;
+    Uint32 version;
+    Uint32 argc;
+    Uint32 envc;
+    Uint32 size;    // bytes that follow: cwd, argv[] and env[], all nul terminated.
+} daemon_request;
+
+static int daemon_listen_fd = -1;
+static char daemon_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+// the environment a session looks at, the clients values replace ours.
+static const char *daemon_env_names[] = {
+    "HOME",
+    "HOTKEY",
+    "PCKILLMODE",
+    "NO_PKILL",
+    "DISPLAY_WIDTH",
+    "DISPLAY_HEIGHT",
+    "TEXTINPUTINTERACTIVE",
+    NULL,
+};
+
+
+static bool daemon_address(struct sockaddr_un *address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+
+    return runtime_path(address->sun_path, sizeof(address->sun_path), ".sock");
+}
+
+
+static bool daemon_peer_ours(int fd)
+{   // the path can be swapped after we looked at it, the kernel knows who is really there.
+    struct ucred peer;
+    socklen_t length = sizeof(peer);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) < 0)
+        return false;
+
+    return (peer.uid == getuid());
+}
+
+
+static int daemon_connect()
+{   // returns the connected fd, or -1 if nobody we trust is listening.
+    struct sockaddr_un address;
+
+    if (!daemon_address(&address) || !runtime_path_ours(address.sun_path))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    if (!daemon_peer_ours(fd))
+    {
+        fprintf(stderr, "'%s' is served by another user, ignoring it.\n", address.sun_path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+static bool daemon_write(int fd, const void *data, size_t size)
+{
+    const char *ptr = (const char *)data;
+
+    while (size > 0)
+    {
+        ssize_t written = write(fd, ptr, size);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+
+        if (written <= 0)
+            return false;
+
+        ptr += written;
+        size -= (size_t)written;
+    }
+
+    return true;
+}
+
+
+static bool daemon_read(int fd, void *data, size_t size)
+{
+    char *ptr = (char *)data;
+
+    while (size > 0)
+    {
+        ssize_t got = read(fd, ptr, size);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+
+        if (got <= 0)
+            return false;
+
+        ptr += got;
+        size -= (size_t)got;
+    }
+
+    return true;
+}
+
+
+bool daemon_running()
+{
+    int fd = daemon_connect();
+
+    if (fd < 0)
+        return false;
+
+    close(fd);
+    return true;
+}
+
+
+int daemon_client(int argc, char* argv[])
+{   // hand our arguments to a running daemon, returns its result or -1 if there isn't one.
+    char cwd[PATH_MAX];
+    daemon_request request;
+    Sint32 result = 1;
+
+    int fd = daemon_connect();
+    if (fd < 0)
+        return -1;
+
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+        cwd[0] = '\0';
+
+    memset(&request, 0, sizeof(request));
+    request.magic   = DAEMON_MAGIC;
+    request.version = DAEMON_VERSION;
+    request.argc    = (Uint32)argc;
+
+    // work out how big it is first.
+    size_t size = strlen(cwd) + 1;
+
+    for (int i=0; i < argc; i++)
+        size += strlen(argv[i]) + 1;
+
+    for (int i=0; daemon_env_names[i] != NULL; i++)
+    {
+        const char *value = getenv(daemon_env_names[i]);
+
+        if (value == NULL)
+            continue;
+
+        size += strlen(daemon_env_names[i]) + 1 + strlen(value) + 1;
+        request.envc++;
+    }
+
+    if (size > DAEMON_MAX_REQUEST)
+    {
+        fprintf(stderr, "Too many arguments to send to the daemon.\n");
+        close(fd);
+        return 1;
+    }
+
+    char *buffer = (char *)gptk_malloc(size);
+    char *ptr = buffer;
+
+    ptr += sprintf(ptr, "%s", cwd) + 1;
+
+    for (int i=0; i < argc; i++)
+        ptr += sprintf(ptr, "%s", argv[i]) + 1;
+
+    for (int i=0; daemon_env_names[i] != NULL; i++)
+    {
+        const char *value = getenv(daemon_env_names[i]);
+
+        if (value != NULL)
+            ptr += sprintf(ptr, "%s=%s", daemon_env_names[i], value) + 1;
+    }
+
+    request.size = (Uint32)size;
+
+    if (!daemon_write(fd, &request, sizeof(request)) ||
+        !daemon_write(fd, buffer, size) ||
+        !daemon_read(fd, &result, sizeof(result)))
+    {
+        fprintf(stderr, "Lost the connection to the daemon.\n");
+        result = 1;
+    }
+
+    free(buffer);
+    close(fd);
+
+    return result;
+}
+
+
+static bool daemon_split(char *buffer, size_t size, char **strings, size_t count)
+{   // point strings[] at each nul terminated string, there must be exactly count of them.
+    size_t found = 0;
+    char *start = buffer;
+
+    if (size == 0 || buffer[size - 1] != '\0')
+        return false;
+
+    for (size_t i=0; i < size; i++)
+    {
+        if (buffer[i] != '\0')
+            continue;
+
+        if (found >= count)
+            return false;
+
+        strings[found++] = start;
+        start = buffer + i + 1;
+    }
+
+    return (found == count);
+}
+
+
+static void daemon_apply_env(char **env, Uint32 envc)
+{   // only the names we know about, anything the client didn't send is unset.
+    for (int i=0; daemon_env_names[i] != NULL; i++)
+        unsetenv(daemon_env_names[i]);
+
+    for (Uint32 i=0; i < envc; i++)
+    {
+        char *value = strchr(env[i], '=');
+
+        if (value == NULL)
+            continue;
+
+        *value++ = '\0';
+
+        for (int j=0; daemon_env_names[j] != NULL; j++)
+        {
+            if (strcmp(env[i], daemon_env_names[j]) == 0)
+            {
+                setenv(env[i], value, 1);
+                break;
+            }
+        }
+    }
+}
+
+
+typedef struct
+{
+    int fd;
+    Uint32 accepted;            // SDL_GetTicks() when it connected
+    size_t got;                 // bytes of header and buffer read so far
+    daemon_request request;
+    char *buffer;
+} daemon_connection;
+
+static daemon_connection daemon_clients[DAEMON_MAX_CLIENTS];
+
+
+static void daemon_drop(daemon_connection *client)
+{
+    loop_unwatch_fd(client->fd);
+    close(client->fd);
+    free(client->buffer);
+
+    memset(client, 0, sizeof(*client));
+    client->fd = -1;
+}
+
+
+static void daemon_serve(daemon_connection *client)
+{   // the whole request is here, switch to it and tell the client how it went.
+    daemon_request *request = &client->request;
+    Sint32 result = 1;
+
+    size_t count = 1 + request->argc + request->envc;
+    char **strings = (char **)gptk_malloc(sizeof(char *) * count);
+    char **argv = (char **)gptk_malloc(sizeof(char *) * (request->argc + 1));
+
+    if (daemon_split(client->buffer, request->size, strings, count))
+    {
+        memcpy(argv, strings + 1, sizeof(char *) * request->argc);
+        argv[request->argc] = NULL;
+
+        daemon_apply_env(strings + 1 + request->argc, request->envc);
+
+        // relative config paths are relative to the client.
+        if (strlen(strings[0]) > 0 && chdir(strings[0]) != 0)
+            fprintf(stderr, "daemon: unable to change to '%s': %s\n", strings[0], strerror(errno));
+
+        printf("daemon: new client '%s'\n", (request->argc > 1) ? argv[request->argc - 1] : argv[0]);
+
+        result = session_switch((int)request->argc, argv);
+    }
+    else
+    {
+        fprintf(stderr, "daemon: bad request.\n");
+    }
+
+    daemon_write(client->fd, &result, sizeof(result));
+
+    free(argv);
+    free(strings);
+}
+
+
+static bool daemon_check(daemon_connection *client)
+{   // the header is in, make room for the rest.
+    daemon_request *request = &client->request;
+    Sint32 result = 1;
+
+    if (request->magic != DAEMON_MAGIC || request->version != DAEMON_VERSION ||
+        request->size == 0 || request->size > DAEMON_MAX_REQUEST ||
+        request->argc == 0 || request->argc > request->size || request->envc > request->size)
+    {
+        fprintf(stderr, "daemon: bad request.\n");
+        daemon_write(client->fd, &result, sizeof(result));
+        return false;
+    }
+
+    client->buffer = (char *)gptk_malloc(request->size);
+    return true;
+}
+
+
+static void daemon_client_callback(int fd, void *data)
+{   // takes whatever has arrived, the request is only acted on once all of it is here.
+    daemon_connection *client = (daemon_connection *)data;
+    (void)fd;
+
+    while (true)
+    {
+        char *target;
+        size_t wanted;
+
+        if (client->got < sizeof(client->request))
+        {
+            target = (char *)&client->request + client->got;
+            wanted = sizeof(client->request) - client->got;
+        }
+        else
+        {
+            target = client->buffer + (client->got - sizeof(client->request));
+            wanted = sizeof(client->request) + client->request.size - client->got;
+        }
+
+        ssize_t got = read(client->fd, target, wanted);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+
+        if (got <= 0)
+        {
+            fprintf(stderr, "daemon: short request.\n");
+            daemon_drop(client);
+            return;
+        }
+
+        client->got += (size_t)got;
+
+        if (client->got == sizeof(client->request) && !daemon_check(client))
+        {
+            daemon_drop(client);
+            return;
+        }
+
+        if (client->got == sizeof(client->request) + client->request.size)
+        {
+            daemon_serve(client);
+            daemon_drop(client);
+            return;
+        }
+    }
+}
+
+
+static daemon_connection *daemon_free_slot()
+{   // if they are all busy the one that has been waiting longest goes.
+    daemon_connection *oldest = &daemon_clients[0];
+
+    for (int i=0; i < DAEMON_MAX_CLIENTS; i++)
+    {
+        if (daemon_clients[i].fd < 0)
+            return &daemon_clients[i];
+
+        if (SDL_TICKS_PASSED(oldest->accepted, daemon_clients[i].accepted))
+            oldest = &daemon_clients[i];
+    }
+
+    fprintf(stderr, "daemon: dropping a client that never finished its request.\n");
+    daemon_drop(oldest);
+
+    return oldest;
+}
+
+
+static void daemon_accept()
+{
+    while (daemon_listen_fd >= 0)
+    {
+        int fd = accept(daemon_listen_fd, NULL, NULL);
+
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            // EAGAIN, nobody else is waiting.
+            return;
+        }
+
+        if (!daemon_peer_ours(fd))
+        {   // the socket is only ours to use, this covers the moment before the chmod.
+            fprintf(stderr, "daemon: refusing a connection from another user.\n");
+            close(fd);
+            continue;
+        }
+
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+
+        daemon_connection *client = daemon_free_slot();
+
+        client->fd = fd;
+        client->accepted = SDL_GetTicks();
+
+        if (!loop_watch_fd(fd, daemon_client_callback, client))
+        {
+            close(fd);
+            client->fd = -1;
+        }
+    }
+}
+
+
+static void daemon_callback(int fd, void *data)
+{
+    (void)fd;
+    (void)data;
+
+    daemon_accept();
+}
+
+
+bool daemon_init()
+{
+    struct sockaddr_un address;
+
+    if (!daemon_address(&address))
+    {
+        fprintf(stderr, "The daemon socket path is too long.\n");
+        return false;
+    }
+
+    // someone else's file can't be replaced, and we won't talk to it either.
+    if (!runtime_path_ours(address.sun_path))
+    {
+        fprintf(stderr, "Unable to start the daemon.\n");
+        return false;
+    }
+
+    int fd = daemon_connect();
+    if (fd >= 0)
+    {
+        close(fd);
+        fprintf(stderr, "A daemon is already listening on '%s'.\n", address.sun_path);
+        return false;
+    }
+
+    // nobody answered, so anything left there is stale.
+    unlink(address.sun_path);
+
+    daemon_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (daemon_listen_fd < 0)
+    {
+        fprintf(stderr, "Unable to create the daemon socket: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (bind(daemon_listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        chmod(address.sun_path, S_IRUSR | S_IWUSR) < 0 ||
+        listen(daemon_listen_fd, 4) < 0)
+    {
+        fprintf(stderr, "Unable to listen on '%s': %s\n", address.sun_path, strerror(errno));
+        close(daemon_listen_fd);
+        daemon_listen_fd = -1;
+        return false;
+    }
+
+    strncpy(daemon_path, address.sun_path, sizeof(daemon_path) - 1);
+
+    for (int i=0; i < DAEMON_MAX_CLIENTS; i++)
+    {
+        memset(&daemon_clients[i], 0, sizeof(daemon_clients[i]));
+        daemon_clients[i].fd = -1;
+    }
+
+    if (!loop_watch_fd(daemon_listen_fd, daemon_callback, NULL))
+    {
+        daemon_quit();
+        return false;
+    }
+
+    printf("Daemon listening on '%s'\n", daemon_path);
+
+    return true;
+}
+
+
+void daemon_quit()
+{
+    if (daemon_listen_fd < 0)
+        return;
+
+    for (int i=0; i < DAEMON_MAX_CLIENTS; i++)
+    {
+        if (daemon_clients[i].fd >= 0)
+            daemon_drop(&daemon_clients[i]);
+    }
+
+    loop_unwatch_fd(daemon_listen_fd);
+
+    close(daemon_listen_fd);
+    daemon_listen_fd = -1;
+
+    unlink(daemon_path);
+}
@@ -0,0 +1,837 @@
+/* Copyright (c) 2021-2024
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 2 of the License, or (at your option) any later version.
+#
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+#
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA 02110-1301 USA
+#
+* Authored by: Kris Henriksen <krishenriksen.work@gmail.com>
+#
+* AnberPorts-Keyboard-Mouse
+*
+* Part of the code is from from https://github.com/krishenriksen/AnberPorts/blob/master/AnberPorts-Keyboard-Mouse/main.c (mostly the fake keyboard)
+* Fake Xbox code from: https://github.com/Emanem/js2xbox
+*
+* Modified (badly) by: Shanti Gilbert for EmuELEC
+* Modified further by: Nikolai Wuttke for EmuELEC (Added support for SDL and the SDLGameControllerdb.txt)
+* Modified further by: Jacob Smith
+*
+* Any help improving this code would be greatly appreciated!
+*
+* DONE: Xbox360 mode: Fix triggers so that they report from 0 to 255 like real Xbox triggers
+*       Xbox360 mode: Figure out why the axis are not correctly labeled?  SDL_CONTROLLER_AXIS_RIGHTX / SDL_CONTROLLER_AXIS_RIGHTY / SDL_CONTROLLER_AXIS_TRIGGERLEFT / SDL_CONTROLLER_AXIS_TRIGGERRIGHT
+*       Keyboard mode: Add a config file option to load mappings from.
+*       add L2/R2 triggers
+*
+*/
+
+#include "gptokeyb2.h"
+
+#include <dirent.h>
+#include <sys/inotify.h>
+
+/* Native evdev input backend.
+ *
+ * Instead of going through the SDL joystick and game controller layers we open
+ * the controllers evdev nodes ourselves and translate the kernel events into
+ * the same SDL_Event structures handleInputEvent() already understands. The
+ * translation table for each device is built from its SDL game controller
+ * mapping, so the buttons end up in the same place as they do with SDL.
+ */
+
+#define EVDEV_INPUT_DIR "/dev/input"
+#define EVDEV_MAX_NAME 64
+#define EVDEV_MAX_HATS 4
+
+enum
+{   // evdev_target kind
+    EVT_NONE,
+    EVT_BUTTON,
+    EVT_AXIS,
+};
+
+typedef struct
+{
+    Uint8 kind;
+    Uint8 target;   // SDL_CONTROLLER_BUTTON_* or SDL_CONTROLLER_AXIS_*
+    Sint8 half;     // for axis targets: 0 whole axis, 1 / -1 only that half
+    bool invert;
+} evdev_target;
+
+typedef struct
+{
+    evdev_target whole;
+    evdev_target negative;
+    evdev_target positive;
+
+    int minimum;
+    int maximum;
+} evdev_axis;
+
+typedef struct _evdev_device
+{
+    struct _evdev_device *next;
+    struct libevdev *dev;
+    int fd;
+    Sint32 which;
+    char name[EVDEV_MAX_NAME];
+
+    evdev_target keys[KEY_CNT];
+    evdev_axis axes[ABS_CNT];
+
+    bool button_state[SDL_CONTROLLER_BUTTON_MAX];
+    Sint16 axis_state[SDL_CONTROLLER_AXIS_MAX];
+} evdev_device;
+
+static const struct
+{
+    const char *name;
+    Uint8 kind;
+    Uint8 target;
+} evdev_outputs[] = {
+    {"a",             EVT_BUTTON, SDL_CONTROLLER_BUTTON_A},
+    {"b",             EVT_BUTTON, SDL_CONTROLLER_BUTTON_B},
+    {"x",             EVT_BUTTON, SDL_CONTROLLER_BUTTON_X},
+    {"y",             EVT_BUTTON, SDL_CONTROLLER_BUTTON_Y},
+    {"back",          EVT_BUTTON, SDL_CONTROLLER_BUTTON_BACK},
+    {"guide",         EVT_BUTTON, SDL_CONTROLLER_BUTTON_GUIDE},
+    {"start",         EVT_BUTTON, SDL_CONTROLLER_BUTTON_START},
+    {"leftstick",     EVT_BUTTON, SDL_CONTROLLER_BUTTON_LEFTSTICK},
+    {"rightstick",    EVT_BUTTON, SDL_CONTROLLER_BUTTON_RIGHTSTICK},
+    {"leftshoulder",  EVT_BUTTON, SDL_CONTROLLER_BUTTON_LEFTSHOULDER},
+    {"rightshoulder", EVT_BUTTON, SDL_CONTROLLER_BUTTON_RIGHTSHOULDER},
+    {"dpup",          EVT_BUTTON, SDL_CONTROLLER_BUTTON_DPAD_UP},
+    {"dpdown",        EVT_BUTTON, SDL_CONTROLLER_BUTTON_DPAD_DOWN},
+    {"dpleft",        EVT_BUTTON, SDL_CONTROLLER_BUTTON_DPAD_LEFT},
+    {"dpright",       EVT_BUTTON, SDL_CONTROLLER_BUTTON_DPAD_RIGHT},
+
+    {"leftx",         EVT_AXIS,   SDL_CONTROLLER_AXIS_LEFTX},
+    {"lefty",         EVT_AXIS,   SDL_CONTROLLER_AXIS_LEFTY},
+    {"rightx",        EVT_AXIS,   SDL_CONTROLLER_AXIS_RIGHTX},
+    {"righty",        EVT_AXIS,   SDL_CONTROLLER_AXIS_RIGHTY},
+    {"lefttrigger",   EVT_AXIS,   SDL_CONTROLLER_AXIS_TRIGGERLEFT},
+    {"righttrigger",  EVT_AXIS,   SDL_CONTROLLER_AXIS_TRIGGERRIGHT},
+};
+
+static evdev_device *evdev_devices = NULL;
+static int evdev_inotify_fd = -1;
+static Sint32 evdev_next_which = 0;
+
+
+static void evdev_dispatch_button(evdev_device *device, int button, bool pressed)
+{
+    SDL_Event event;
+
+    if (device->button_state[button] == pressed)
+        return;
+
+    device->button_state[button] = pressed;
+
+    memset(&event, 0, sizeof(event));
+    event.type = pressed ? SDL_CONTROLLERBUTTONDOWN : SDL_CONTROLLERBUTTONUP;
+    event.cbutton.which  = device->which;
+    event.cbutton.button = (Uint8)button;
+    event.cbutton.state  = pressed ? 1 : 0;
+
+    handleInputEvent(&event);
+}
+
+
+static void evdev_dispatch_axis(evdev_device *device, int axis, int value)
+{
+    SDL_Event event;
+
+    if (value < INT16_MIN)
+        value = INT16_MIN;
+
+    if (value > INT16_MAX)
+        value = INT16_MAX;
+
+    if (device->axis_state[axis] == value)
+        return;
+
+    device->axis_state[axis] = (Sint16)value;
+
+    memset(&event, 0, sizeof(event));
+    event.type = SDL_CONTROLLERAXISMOTION;
+    event.caxis.which = device->which;
+    event.caxis.axis  = (Uint8)axis;
+    event.caxis.value = (Sint16)value;
+
+    handleInputEvent(&event);
+}
+
+
+static void evdev_apply(evdev_device *device, const evdev_target *target, int value, int input_min, int input_max)
+{   // value is already normalised to the signed 16 bit range, input_min/max is the part of it this binding uses.
+    if (target->kind == EVT_BUTTON)
+    {
+        int threshold = input_min + (input_max - input_min) / 2;
+
+        if (input_max > input_min)
+            evdev_dispatch_button(device, target->target, value > threshold);
+        else
+            evdev_dispatch_button(device, target->target, value < threshold);
+    }
+    else if (target->kind == EVT_AXIS)
+    {
+        int output_min = 0;
+        int output_max = INT16_MAX;
+
+        if (target->half < 0)
+            output_max = INT16_MIN;
+
+        else if (target->half == 0 &&
+                 target->target != SDL_CONTROLLER_AXIS_TRIGGERLEFT &&
+                 target->target != SDL_CONTROLLER_AXIS_TRIGGERRIGHT)
+            output_min = INT16_MIN;
+
+        if (target->invert)
+            value = input_min + input_max - value;
+
+        evdev_dispatch_axis(device, target->target,
+            output_min + (int)(((Sint64)(value - input_min) * (output_max - output_min)) / (input_max - input_min)));
+    }
+}
+
+
+static void evdev_release(evdev_device *device, const evdev_target *target)
+{
+    if (target->kind == EVT_BUTTON)
+        evdev_dispatch_button(device, target->target, false);
+
+    else if (target->kind == EVT_AXIS)
+        evdev_dispatch_axis(device, target->target, 0);
+}
+
+
+static void evdev_handle_key(evdev_device *device, int code, int value)
+{
+    const evdev_target *target = &device->keys[code];
+
+    if (target->kind == EVT_BUTTON)
+    {
+        evdev_dispatch_button(device, target->target, value != 0);
+    }
+    else if (target->kind == EVT_AXIS)
+    {
+        if (value == 0)
+            evdev_release(device, target);
+
+        else if (target->half < 0)
+            evdev_dispatch_axis(device, target->target, INT16_MIN);
+
+        else
+            evdev_dispatch_axis(device, target->target, INT16_MAX);
+    }
+}
+
+
+static void evdev_handle_abs(evdev_device *device, int code, int raw_value)
+{
+    evdev_axis *axis = &device->axes[code];
+    int value;
+
+    if (axis->maximum <= axis->minimum)
+        return;
+
+    // normalise to the same range SDL uses
+    value = (int)(((Sint64)(raw_value - axis->minimum) * 65535) / (axis->maximum - axis->minimum)) + INT16_MIN;
+
+    if (value < INT16_MIN)
+        value = INT16_MIN;
+
+    if (value > INT16_MAX)
+        value = INT16_MAX;
+
+    if (axis->whole.kind != EVT_NONE)
+        evdev_apply(device, &axis->whole, value, INT16_MIN, INT16_MAX);
+
+    if (axis->negative.kind != EVT_NONE)
+    {
+        if (value < 0)
+            evdev_apply(device, &axis->negative, value, 0, INT16_MIN);
+        else
+            evdev_release(device, &axis->negative);
+    }
+
+    if (axis->positive.kind != EVT_NONE)
+    {
+        if (value > 0)
+            evdev_apply(device, &axis->positive, value, 0, INT16_MAX);
+        else
+            evdev_release(device, &axis->positive);
+    }
+}
+
+
+static bool evdev_parse_output(const char *name, evdev_target *target)
+{
+    target->half = 0;
+    target->invert = false;
+
+    if (*name == '+' || *name == '-')
+    {
+        target->half = (*name == '+') ? 1 : -1;
+        name++;
+    }
+
+    for (size_t i=0; i < (sizeof(evdev_outputs) / sizeof(evdev_outputs[0])); i++)
+    {
+        if (strcmp(name, evdev_outputs[i].name) == 0)
+        {
+            target->kind   = evdev_outputs[i].kind;
+            target->target = evdev_outputs[i].target;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static void evdev_parse_mapping(evdev_device *device, const char *mapping)
+{   /* Turns an SDL mapping string into our translation table.
+     *
+     * SDL numbers the buttons, axes and hats of a linux joystick in the order
+     * it finds them on the device, we do the same to get back to evdev codes.
+     */
+    int button_codes[KEY_CNT];
+    int axis_codes[ABS_CNT];
+    int hat_codes[EVDEV_MAX_HATS];
+    int num_buttons = 0;
+    int num_axes = 0;
+    int num_hats = 0;
+
+    for (int code = BTN_JOYSTICK; code < KEY_MAX; code++)
+    {
+        if (libevdev_has_event_code(device->dev, EV_KEY, code))
+            button_codes[num_buttons++] = code;
+    }
+
+    for (int code = 0; code < BTN_JOYSTICK; code++)
+    {
+        if (libevdev_has_event_code(device->dev, EV_KEY, code))
+            button_codes[num_buttons++] = code;
+    }
+
+    for (int code = 0; code < ABS_MAX; code++)
+    {
+        if (code == ABS_HAT0X)
+        {
+            code = ABS_HAT3Y;
+            continue;
+        }
+
+        if (libevdev_has_event_code(device->dev, EV_ABS, code))
+            axis_codes[num_axes++] = code;
+    }
+
+    for (int code = ABS_HAT0X; code <= ABS_HAT3Y; code += 2)
+    {
+        if (libevdev_has_event_code(device->dev, EV_ABS, code) ||
+            libevdev_has_event_code(device->dev, EV_ABS, code + 1))
+            hat_codes[num_hats++] = code;
+    }
+
+    char *temp_mapping = strdup(mapping);
+    char *save_ptr = NULL;
+    int field = 0;
+
+    for (char *item = strtok_r(temp_mapping, ",", &save_ptr); item != NULL; item = strtok_r(NULL, ",", &save_ptr), field++)
+    {
+        evdev_target target;
+
+        // skip the guid and name
+        if (field < 2)
+            continue;
+
+        char *input = strchr(item, ':');
+        if (input == NULL)
+            continue;
+
+        *(input++) = '\0';
+
+        if (!evdev_parse_output(item, &target))
+            continue;
+
+        int input_half = 0;
+        if (*input == '+' || *input == '-')
+        {
+            input_half = (*input == '+') ? 1 : -1;
+            input++;
+        }
+
+        if (input[0] == 'b')
+        {
+            int index = atoi(input + 1);
+
+            if (index >= 0 && index < num_buttons)
+                device->keys[button_codes[index]] = target;
+        }
+        else if (input[0] == 'a')
+        {
+            int index = atoi(input + 1);
+
+            if (index < 0 || index >= num_axes)
+                continue;
+
+            target.invert = (strchr(input, '~') != NULL);
+
+            evdev_axis *axis = &device->axes[axis_codes[index]];
+
+            if (input_half < 0)
+                axis->negative = target;
+
+            else if (input_half > 0)
+                axis->positive = target;
+
+            else
+                axis->whole = target;
+        }
+        else if (input[0] == 'h')
+        {
+            int index = atoi(input + 1);
+            char *mask_str = strchr(input, '.');
+
+            if (index < 0 || index >= num_hats || mask_str == NULL)
+                continue;
+
+            int mask = atoi(mask_str + 1);
+            int hat_code = hat_codes[index];
+
+            if (mask & 0x01)
+                device->axes[hat_code + 1].negative = target;
+
+            else if (mask & 0x02)
+                device->axes[hat_code].positive = target;
+
+            else if (mask & 0x04)
+                device->axes[hat_code + 1].positive = target;
+
+            else if (mask & 0x08)
+                device->axes[hat_code].negative = target;
+        }
+    }
+
+    free(temp_mapping);
+}
+
+
+static void evdev_default_mapping(evdev_device *device)
+{   // no SDL mapping, assume the device follows the linux gamepad layout.
+    const struct { int code; Uint8 button; } keys[] = {
+        {BTN_A,          SDL_CONTROLLER_BUTTON_A},
+        {BTN_B,          SDL_CONTROLLER_BUTTON_B},
+        {BTN_X,          SDL_CONTROLLER_BUTTON_X},
+        {BTN_Y,          SDL_CONTROLLER_BUTTON_Y},
+        {BTN_SELECT,     SDL_CONTROLLER_BUTTON_BACK},
+        {BTN_MODE,       SDL_CONTROLLER_BUTTON_GUIDE},
+        {BTN_START,      SDL_CONTROLLER_BUTTON_START},
+        {BTN_THUMBL,     SDL_CONTROLLER_BUTTON_LEFTSTICK},
+        {BTN_THUMBR,     SDL_CONTROLLER_BUTTON_RIGHTSTICK},
+        {BTN_TL,         SDL_CONTROLLER_BUTTON_LEFTSHOULDER},
+        {BTN_TR,         SDL_CONTROLLER_BUTTON_RIGHTSHOULDER},
+        {BTN_DPAD_UP,    SDL_CONTROLLER_BUTTON_DPAD_UP},
+        {BTN_DPAD_DOWN,  SDL_CONTROLLER_BUTTON_DPAD_DOWN},
+        {BTN_DPAD_LEFT,  SDL_CONTROLLER_BUTTON_DPAD_LEFT},
+        {BTN_DPAD_RIGHT, SDL_CONTROLLER_BUTTON_DPAD_RIGHT},
+    };
+
+    const struct { int code; Uint8 axis; } axes[] = {
+        {ABS_X,  SDL_CONTROLLER_AXIS_LEFTX},
+        {ABS_Y,  SDL_CONTROLLER_AXIS_LEFTY},
+        {ABS_RX, SDL_CONTROLLER_AXIS_RIGHTX},
+        {ABS_RY, SDL_CONTROLLER_AXIS_RIGHTY},
+        {ABS_Z,  SDL_CONTROLLER_AXIS_TRIGGERLEFT},
+        {ABS_RZ, SDL_CONTROLLER_AXIS_TRIGGERRIGHT},
+    };
+
+    for (size_t i=0; i < (sizeof(keys) / sizeof(keys[0])); i++)
+    {
+        device->keys[keys[i].code].kind   = EVT_BUTTON;
+        device->keys[keys[i].code].target = keys[i].button;
+    }
+
+    // digital triggers
+    device->keys[BTN_TL2].kind   = EVT_AXIS;
+    device->keys[BTN_TL2].target = SDL_CONTROLLER_AXIS_TRIGGERLEFT;
+    device->keys[BTN_TR2].kind   = EVT_AXIS;
+    device->keys[BTN_TR2].target = SDL_CONTROLLER_AXIS_TRIGGERRIGHT;
+
+    for (size_t i=0; i < (sizeof(axes) / sizeof(axes[0])); i++)
+    {
+        device->axes[axes[i].code].whole.kind   = EVT_AXIS;
+        device->axes[axes[i].code].whole.target = axes[i].axis;
+    }
+
+    device->axes[ABS_HAT0X].negative.kind   = EVT_BUTTON;
+    device->axes[ABS_HAT0X].negative.target = SDL_CONTROLLER_BUTTON_DPAD_LEFT;
+    device->axes[ABS_HAT0X].positive.kind   = EVT_BUTTON;
+    device->axes[ABS_HAT0X].positive.target = SDL_CONTROLLER_BUTTON_DPAD_RIGHT;
+    device->axes[ABS_HAT0Y].negative.kind   = EVT_BUTTON;
+    device->axes[ABS_HAT0Y].negative.target = SDL_CONTROLLER_BUTTON_DPAD_UP;
+    device->axes[ABS_HAT0Y].positive.kind   = EVT_BUTTON;
+    device->axes[ABS_HAT0Y].positive.target = SDL_CONTROLLER_BUTTON_DPAD_DOWN;
+}
+
+
+static char *evdev_find_mapping(evdev_device *device)
+{   // build the same guid SDL would for this device and ask it for the mapping.
+    Uint8 data[16];
+    char guid_str[33];
+    Uint16 bustype = (Uint16)libevdev_get_id_bustype(device->dev);
+    Uint16 vendor  = (Uint16)libevdev_get_id_vendor(device->dev);
+    Uint16 product = (Uint16)libevdev_get_id_product(device->dev);
+    Uint16 version = (Uint16)libevdev_get_id_version(device->dev);
+
+    memset(data, 0, sizeof(data));
+
+    data[0] = bustype & 0xff;
+    data[1] = bustype >> 8;
+
+    if (vendor != 0 && product != 0)
+    {
+        data[4]  = vendor & 0xff;
+        data[5]  = vendor >> 8;
+        data[8]  = product & 0xff;
+        data[9]  = product >> 8;
+        data[12] = version & 0xff;
+        data[13] = version >> 8;
+    }
+    else
+    {
+        strncpy((char *)&data[4], device->name, sizeof(data) - 4);
+    }
+
+    for (int pass=0; pass < 2; pass++)
+    {
+        if (pass == 1)
+        {   // try again ignoring the version
+            if (vendor == 0 || product == 0 || version == 0)
+                break;
+
+            data[12] = 0;
+            data[13] = 0;
+        }
+
+        for (int i=0; i < 16; i++)
+            snprintf(&guid_str[i * 2], 3, "%02x", data[i]);
+
+        char *mapping = SDL_GameControllerMappingForGUID(SDL_JoystickGetGUIDFromString(guid_str));
+
+        if (mapping != NULL)
+            return mapping;
+    }
+
+    return NULL;
+}
+
+
+static bool evdev_is_gamepad(struct libevdev *dev)
+{
+    if (!libevdev_has_event_type(dev, EV_KEY))
+        return false;
+
+    for (int code = BTN_JOYSTICK; code < BTN_DIGI; code++)
+    {
+        if (libevdev_has_event_code(dev, EV_KEY, code))
+            return true;
+    }
+
+    for (int code = BTN_TRIGGER_HAPPY; code <= BTN_TRIGGER_HAPPY40; code++)
+    {
+        if (libevdev_has_event_code(dev, EV_KEY, code))
+            return true;
+    }
+
+    return false;
+}
+
+
+static bool evdev_is_own_device(const char *node_name)
+{   // check if an event node belongs to one of our uinput devices.
+    char path[PATH_MAX];
+    char link[PATH_MAX];
+    char sysname[EVDEV_MAX_NAME];
+    int own_fds[] = {kb_uinp_fd, abs_uinp_fd, xbox_uinp_fd};
+
+    snprintf(path, sizeof(path), "/sys/class/input/%s/device", node_name);
+
+    ssize_t link_len = readlink(path, link, sizeof(link) - 1);
+    if (link_len < 0)
+        return false;
+
+    link[link_len] = '\0';
+
+    const char *input_name = strrchr(link, '/');
+    input_name = (input_name == NULL) ? link : input_name + 1;
+
+    for (size_t i=0; i < (sizeof(own_fds) / sizeof(own_fds[0])); i++)
+    {
+        if (own_fds[i] <= 0)
+            continue;
+
+        memset(sysname, 0, sizeof(sysname));
+
+        if (ioctl(own_fds[i], UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0)
+            continue;
+
+        if (strcmp(sysname, input_name) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+
+static void evdev_remove_device(evdev_device *device)
+{
+    evdev_device *current = evdev_devices;
+    evdev_device *prev = NULL;
+
+    while (current != NULL)
+    {
+        if (current == device)
+        {
+            if (prev != NULL)
+                prev->next = current->next;
+            else
+                evdev_devices = current->next;
+
+            break;
+        }
+
+        prev = current;
+        current = current->next;
+    }
+
+    printf("Joystick '%s' removed.\n", device->name);
+
+    loop_remove_fd(device->fd);
+    controller_remove_fd(device->which);
+
+    libevdev_free(device->dev);
+    close(device->fd);
+    free(device);
+}
+
+
+static void evdev_device_callback(int fd, void *data)
+{
+    evdev_device *device = (evdev_device *)data;
+    struct input_event event;
+    unsigned int flags = LIBEVDEV_READ_FLAG_NORMAL;
+    (void)fd;
+
+    while (true)
+    {
+        int rc = libevdev_next_event(device->dev, flags, &event);
+
+        if (rc == LIBEVDEV_READ_STATUS_SYNC)
+        {   // we dropped events, libevdev hands us the difference.
+            flags = LIBEVDEV_READ_FLAG_SYNC;
+        }
+        else if (rc == -EAGAIN)
+        {
+            if (flags == LIBEVDEV_READ_FLAG_SYNC)
+            {
+                flags = LIBEVDEV_READ_FLAG_NORMAL;
+                continue;
+            }
+
+            break;
+        }
+        else if (rc != LIBEVDEV_READ_STATUS_SUCCESS)
+        {
+            evdev_remove_device(device);
+            return;
+        }
+
+        if (event.type == EV_KEY && event.code < KEY_CNT)
+            evdev_handle_key(device, event.code, event.value);
+
+        else if (event.type == EV_ABS && event.code < ABS_CNT)
+            evdev_handle_abs(device, event.code, event.value);
+    }
+}
+
+
+static void evdev_open_device(const char *node_name)
+{
+    char path[PATH_MAX];
+    struct libevdev *dev = NULL;
+
+    if (!strstartswith(node_name, "event"))
+        return;
+
+    for (evdev_device *current = evdev_devices; current != NULL; current = current->next)
+    {
+        if (strcmp(current->name, node_name) == 0)
+            return;
+    }
+
+    if (evdev_is_own_device(node_name))
+        return;
+
+    snprintf(path, sizeof(path), EVDEV_INPUT_DIR "/%s", node_name);
+
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    if (libevdev_new_from_fd(fd, &dev) < 0)
+    {
+        close(fd);
+        return;
+    }
+
+    if (!evdev_is_gamepad(dev))
+    {
+        libevdev_free(dev);
+        close(fd);
+        return;
+    }
+
+    evdev_device *device = (evdev_device *)gptk_malloc(sizeof(evdev_device));
+
+    device->dev = dev;
+    device->fd = fd;
+    device->which = evdev_next_which++;
+    strncpy(device->name, node_name, EVDEV_MAX_NAME - 1);
+
+    for (int code = 0; code < ABS_CNT; code++)
+    {
+        const struct input_absinfo *info = libevdev_get_abs_info(dev, code);
+
+        if (info == NULL)
+            continue;
+
+        device->axes[code].minimum = info->minimum;
+        device->axes[code].maximum = info->maximum;
+    }
+
+    char *mapping = evdev_find_mapping(device);
+
+    if (mapping != NULL)
+    {
+        evdev_parse_mapping(device, mapping);
+        SDL_free(mapping);
+    }
+    else
+    {
+        printf("No mapping for '%s', using the default gamepad layout.\n", libevdev_get_name(dev));
+        evdev_default_mapping(device);
+    }
+
+    if (!loop_add_fd(fd, evdev_device_callback, device))
+    {
+        libevdev_free(dev);
+        close(fd);
+        free(device);
+        return;
+    }
+
+    device->next = evdev_devices;
+    evdev_devices = device;
+
+    printf("Joystick '%s' (%s) opened.\n", libevdev_get_name(dev), node_name);
+
+    controller_add_fd(device->which, fd);
+}
+
+
+static void evdev_inotify_callback(int fd, void *data)
+{
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    (void)data;
+
+    while (true)
+    {
+        ssize_t len = read(fd, buffer, sizeof(buffer));
+
+        if (len <= 0)
+            break;
+
+        for (char *ptr = buffer; ptr < buffer + len; )
+        {
+            const struct inotify_event *event = (const struct inotify_event *)ptr;
+
+            // udev fixes the permissions after the node is created, so try again on IN_ATTRIB.
+            if (event->len > 0)
+                evdev_open_device(event->name);
+
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+
+bool evdev_init()
+{
+    DIR *dir = opendir(EVDEV_INPUT_DIR);
+
+    if (dir == NULL)
+    {
+        fprintf(stderr, "Unable to open %s: %s\n", EVDEV_INPUT_DIR, strerror(errno));
+        return false;
+    }
+
+    struct dirent *entry;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        evdev_open_device(entry->d_name);
+    }
+
+    closedir(dir);
+
+    evdev_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (evdev_inotify_fd >= 0)
+    {
+        if (inotify_add_watch(evdev_inotify_fd, EVDEV_INPUT_DIR, IN_CREATE | IN_ATTRIB) < 0 ||
+            !loop_add_fd(evdev_inotify_fd, evdev_inotify_callback, NULL))
+        {
+            fprintf(stderr, "Unable to watch %s for new controllers.\n", EVDEV_INPUT_DIR);
+            close(evdev_inotify_fd);
+            evdev_inotify_fd = -1;
+        }
+    }
+
+    return true;
+}
+
+
+void evdev_quit()
+{
+    while (evdev_devices != NULL)
+    {
+        evdev_device *device = evdev_devices;
+        evdev_devices = device->next;
+
+        loop_remove_fd(device->fd);
+        controller_remove_fd(device->which);
+
+        libevdev_free(device->dev);
+        close(device->fd);
+        free(device);
+    }
+
+    if (evdev_inotify_fd >= 0)
+    {
+        loop_remove_fd(evdev_inotify_fd);
+        close(evdev_inotify_fd);
+        evdev_inotify_fd = -1;
+    }
+}
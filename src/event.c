@@ -137,5 +137,9 @@ void handleInputEvent(const SDL_Event *event)
     case SDL_QUIT:
         current_state.running = false;
         return;
+
+    default:
+        loop_handle_event(event);
+        break;
     }
 }
@@ -41,7 +41,9 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -227,6 +229,9 @@ enum
 // simple tokenizer
 typedef struct _token_ctx token_ctx;
 
+// bump allocator for data that is freed all at once
+typedef struct _gptk_arena gptk_arena;
+
 
 #define MOUSE_MOVEMENT_PARENT -1
 #define MOUSE_MOVEMENT_OFF 0
@@ -247,9 +252,29 @@ typedef struct
 } gptokeyb_button;
 
 
+// layer_summary flags
+#define LSF_DPAD_AS_MOUSE                  0x01
+#define LSF_LEFT_ANALOG_AS_MOUSE           0x02
+#define LSF_RIGHT_ANALOG_AS_MOUSE          0x04
+#define LSF_LEFT_ANALOG_AS_ABSOLUTE_MOUSE  0x08
+#define LSF_RIGHT_ANALOG_AS_ABSOLUTE_MOUSE 0x10
+
+// The parts of a config that get resolved through the stack, precomputed so layers can be combined quickly.
+typedef struct
+{
+    Uint32 decided;             // LSF_* flags this layer doesn't leave to its parent
+    Uint32 enabled;             // LSF_* flags that are on
+    int exclusive_mode;         // EXL_PARENT if not decided
+    Uint32 mouse_wheel_amount;  // 0 if not decided
+    const char *charset;        // both NULL if not decided
+    const char *wordset;
+} layer_summary;
+
+
 struct _gptokeyb_config
 {
     gptokeyb_config *next;
+    gptokeyb_config *hash_next;
     const char *name;
 
     const char *charset;
@@ -274,6 +299,7 @@ struct _gptokeyb_config
     Uint32 mouse_wheel_amount;
 
     bool map_check;
+    layer_summary summary;
     gptokeyb_button button[GBTN_MAX];
 };
 
@@ -332,6 +358,7 @@ typedef struct
     bool running;
 
     Uint64 mouse_delay;
+    Uint64 mouse_tick;
     Uint64 repeat_delay;
     Uint64 repeat_rate;
 } gptokeyb_state;
@@ -378,6 +405,13 @@ typedef struct
     float y;
 } vector2d;
 
+// the same in Q15 fixed point, 32768 is 1.0
+typedef struct
+{
+    Sint32 x;
+    Sint32 y;
+} vector2q;
+
 
 // some stuff
 extern const keyboard_values keyboard_codes[];
@@ -391,8 +425,10 @@ extern gptokeyb_config *root_config;
 extern gptokeyb_config *config_stack[];
 extern gptokeyb_config *default_config;
 extern gptokeyb_config *config_temp_stack[];
-extern int config_temp_stack_order[];
-extern int config_temp_stack_order_id;
+extern int config_temp_stack_prev[];
+extern int config_temp_stack_next[];
+extern int config_temp_stack_top;
+extern int config_temp_stack_bottom;
 
 extern gptokeyb_state current_state;
 extern int gptokeyb_config_depth;
@@ -412,15 +448,61 @@ extern int abs_uinp_fd;  // fake absolute position mouse
 
 // stuff
 extern bool xbox360_mode;
+extern bool evdev_mode;
 extern bool config_mode;
+extern bool daemon_mode;
 
 extern bool want_pc_quit;
 extern bool want_kill;
 extern bool want_sudo;
 extern char kill_process_name[];
 
+#define MAX_PROCESS_NAME 64
+
 extern char game_prefix[];
 
+extern bool config_cache_finalised;
+extern int gptk_hk_can_fix;
+
+// main.c
+extern bool session_ended;
+
+int session_switch(int argc, char* argv[]);
+
+// daemon.c
+bool daemon_init();
+void daemon_quit();
+bool daemon_running();
+int daemon_client(int argc, char* argv[]);
+
+// child.c
+void child_prepare();
+bool child_start(int argc, char* argv[]);
+bool child_running();
+bool child_signal(int sig);
+int child_exit_status();
+void child_quit();
+
+// control.c
+bool control_init();
+void control_quit();
+int control_send(const char *command);
+
+// status.c
+bool status_init();
+void status_quit();
+void status_pressed();
+void status_update();
+
+// reload.c
+bool reload_init();
+void reload_quit();
+void reload_add(const char *file_name, bool optional);
+void reload_clear();
+bool reload_check();
+bool reload_next(Uint32 *next_ticks);
+bool reload_ready(Uint32 current_ticks);
+
 // config.c
 void config_init();
 void config_quit();
@@ -428,10 +510,21 @@ void config_dump();
 void config_finalise();
 
 void config_overlay_clear(gptokeyb_config *current);
+void config_summarise(gptokeyb_config *current);
 gptokeyb_config *config_find(const char *name);
 gptokeyb_config *config_create(const char *name);
 void config_free(gptokeyb_config *config);
 int config_load(const char *file_name, bool config_only);
+bool atob_default(const char *value, bool default_value);
+
+size_t config_setting_count();
+bool config_setting_get(size_t index, const char **name, Sint64 *value);
+bool config_setting_set(const char *name, Sint64 value);
+
+// cache.c
+void cache_prepare(const char *file_name);
+bool cache_load();
+bool cache_save();
 
 // analog.c
 void vector2d_clear(vector2d *vec2d);
@@ -446,6 +539,23 @@ const char *deadzone_mode_str(int mode);
 void deadzone_trigger_calc(int *analog, int analog_in);
 void deadzone_mouse_calc(int *x, int *y, int in_x, int in_y);
 
+void dz_axial(vector2d *vec2d_ouput, const vector2d *vec2d_input, float deadzone);
+void dz_radial(vector2d *vec2d_ouput, const vector2d *vec2d_input, float deadzone);
+void dz_scaled_radial(vector2d *vec2d_ouput, const vector2d *vec2d_input, float deadzone);
+void dz_sloped_axial(vector2d *vec2d_ouput, const vector2d *vec2d_input, float deadzone);
+void dz_sloped_scaled_axial(vector2d *vec2d_ouput, const vector2d *vec2d_input, float deadzone);
+void dz_hybrid(vector2d *vec2d_ouput, const vector2d *vec2d_input, float deadzone);
+void dz_exp(vector2d *vec2d_ouput, const vector2d *vec2d_input, float deadzone, float n);
+
+// analog_fixed.c
+void dzq_axial(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone);
+void dzq_radial(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone);
+void dzq_scaled_radial(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone);
+void dzq_sloped_axial(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone);
+void dzq_sloped_scaled_axial(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone);
+void dzq_hybrid(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone);
+void dzq_exp(vector2q *vec2q_output, const vector2q *vec2q_input, Sint32 deadzone, Sint32 n);
+
 // keys.c
 const keyboard_values *find_keyboard(const char *key);
 const char *find_keycode(short keycode);
@@ -453,18 +563,24 @@ const button_match *find_button(const char *key);
 void set_hotkey(int gbtn);
 
 // util.c -- CHATGPT
+extern gptk_arena *load_arena;
+
 void *gptk_malloc(size_t);
 void *gptk_realloc(void *, size_t, size_t);
 
+gptk_arena *arena_create();
+void *arena_alloc(gptk_arena *arena, size_t size);
+void arena_destroy(gptk_arena *arena);
+size_t arena_allocated(const gptk_arena *arena);
+
 token_ctx *tokens_create(const char *input_text, char separator);
 void tokens_free(token_ctx *token_state);
+bool tokens_tabulate(token_ctx *token_state, const char *text);
 const char *tokens_next(token_ctx *token_state);
 const char *tokens_prev(token_ctx *token_state);
 const char *tokens_curr(token_ctx *token_state);
 const char *tokens_rest(token_ctx *token_state);
 
-char *tabulate_text(const char *text);
-
 bool strendswith(const char *str, const char *suffix);
 bool strcaseendswith(const char *str, const char *suffix);
 
@@ -474,14 +590,26 @@ bool strcasestartswith(const char *str, const char *suffix);
 int strcasecmp(const char *s1, const char *s2);
 int strncasecmp(const char *s1, const char *s2, size_t n);
 
+bool runtime_path(char *path, size_t size, const char *suffix);
+bool runtime_path_ours(const char *path);
 bool process_kill();
+void process_quit();
 
 void string_init();
 void string_quit();
 const char *string_register(const char *string);
+void string_dump_stats();
 
 // from og gptokeyb
 void emit(int fd, int type, int code, int val);
+void emit_flush();
+void emit_forget(int fd);
+void output_queue_key(Uint32 due, int fd, int code, bool pressed, int modifier);
+void output_queue_call(void (*call)(void));
+bool output_queue_next(Uint32 *next_ticks);
+void output_queue_run(Uint32 current_ticks);
+void output_queue_drain();
+void output_queue_quit();
 void emitRelativeMouseMotion(int x, int y);
 void emitAbsoluteMouseMotion(int x, int y);
 void emitMouseWheel(int wheel);
@@ -491,6 +619,9 @@ void emitKey(int fd, int code, bool is_pressed, int modifier);
 void handleAnalogTrigger(bool is_triggered, bool *was_triggered, int key, int modifier);
 
 // input.c
+extern char_set *root_char_set;
+extern word_set *root_word_set;
+
 const char_set *find_char_set(const char *name);
 const word_set *find_word_set(const char *name);
 
@@ -500,6 +631,7 @@ void input_quit();
 void register_char_set(const char *name, const char *characters);
 void register_word_set(const char *name, const char *word);
 
+void input_need_keys();
 void input_load_char_set(const char *name);
 void input_load_word_set(const char *name);
 void input_stop();
@@ -510,6 +642,7 @@ void input_cancel();
 void input_disable();
 
 bool input_active();
+const char *input_current_text(size_t *cursor);
 
 void input_set_state(const char *buff, size_t buff_len);
 void input_clear_state();
@@ -537,13 +670,18 @@ void update_button(int btn, bool pressed);
 
 void state_init();
 void state_quit();
+void state_release();
+void state_reset();
 void state_update();
+void state_process_killed();
+bool state_next_repeat(Uint32 *next_ticks);
 gptokeyb_config *state_active();
 
 void push_state(gptokeyb_config *);
 void set_state(gptokeyb_config *);
 void pop_state();
 void state_change_update();
+void state_config_changed();
 
 void controllers_enable_exclusive();
 void controllers_disable_exclusive();
@@ -556,7 +694,27 @@ bool isExistingController(SDL_JoystickID id);
 void recordExistingControllers();
 void handleInputEvent(const SDL_Event *event);
 
+// evdev.c
+bool evdev_init();
+void evdev_quit();
+
+// loop.c
+typedef void (*loop_callback)(int fd, void *data);
+
+bool loop_init();
+void loop_quit();
+bool loop_add_fd(int fd, loop_callback callback, void *data);
+void loop_remove_fd(int fd);
+void loop_wait(Sint32 timeout);
+
+bool loop_watch_fd(int fd, loop_callback callback, void *data);
+void loop_unwatch_fd(int fd);
+bool loop_handle_event(const SDL_Event *event);
+
 // keyboard.c
+void keyboard_need_key(int keycode);
+void keyboard_need_everything();
+bool keyboard_needs_absolute_mouse();
 void setupFakeKeyboardMouseDevice();
 void setupFakeAbsoluteMouseDevice();
 void handleEventBtnFakeKeyboardMouseDevice(const SDL_Event *event, bool is_pressed);
@@ -138,8 +138,10 @@ int ini_parse_stream(ini_reader reader, void* stream, ini_handler handler,
         offset = strlen(line);
         while (offset == max_line - 1 && line[offset - 1] != '\n') {
             max_line *= 2;
+#if INI_MAX_LINE > 0
             if (max_line > INI_MAX_LINE)
                 max_line = INI_MAX_LINE;
+#endif
             new_line = ini_realloc(line, max_line);
             if (!new_line) {
                 ini_free(line);
@@ -148,8 +150,10 @@ int ini_parse_stream(ini_reader reader, void* stream, ini_handler handler,
             line = new_line;
             if (reader(line + offset, (int)(max_line - offset), stream) == NULL)
                 break;
+#if INI_MAX_LINE > 0
             if (max_line >= INI_MAX_LINE)
                 break;
+#endif
             offset += strlen(line + offset);
         }
 #endif
@@ -230,6 +230,17 @@ void input_init()
 }
 
 
+void input_need_keys()
+{   // tell the fake keyboard about every key text input can type.
+    for (int i=0; i < 256; i++)
+        keyboard_need_key(characters[i].keycode);
+
+    keyboard_need_key(KEY_LEFTSHIFT);
+    keyboard_need_key(KEY_BACKSPACE);
+    keyboard_need_key(KEY_ENTER);
+}
+
+
 void dump_char_sets()
 {
     char_set *curr_char_set = root_char_set;
@@ -293,7 +304,7 @@ void register_char_set(const char *name, const char *characters)
     if (new_char_set == NULL)
     {
         char_set_created = true;
-        new_char_set = (char_set*)gptk_malloc(sizeof(char_set));
+        new_char_set = (char_set*)arena_alloc(load_arena, sizeof(char_set));
     }
 
     new_char_set->name       = string_register(name);
@@ -325,10 +336,10 @@ void register_word_set(const char *name, const char *word)
 
     if (curr_word_set == NULL)
     {   // create a new one
-        curr_word_set = (word_set*)gptk_malloc(sizeof(word_set));
+        curr_word_set = (word_set*)arena_alloc(load_arena, sizeof(word_set));
 
         curr_word_set->name = string_register(name);
-        curr_word_set->words = (const char **)gptk_malloc(sizeof(char*) * WORDS_SIZE_DEFAULT);
+        curr_word_set->words = (const char **)arena_alloc(load_arena, sizeof(char*) * WORDS_SIZE_DEFAULT);
         curr_word_set->words_alloc = WORDS_SIZE_DEFAULT;
 
         curr_word_set->next  = root_word_set;
@@ -336,14 +347,13 @@ void register_word_set(const char *name, const char *word)
     }
 
     if ((curr_word_set->words_len+1) >= curr_word_set->words_alloc)
-    {   // resize the words buffer if we need to
-        size_t new_size = curr_word_set->words_alloc + WORDS_SIZE_DEFAULT;
+    {   // grow the words buffer if we need to, doubling keeps what is left behind in the arena small.
+        size_t new_size = curr_word_set->words_alloc * 2;
+        const char **new_words = (const char **)arena_alloc(load_arena, sizeof(char*) * new_size);
 
-        curr_word_set->words = (const char **)gptk_realloc(
-            curr_word_set->words,
-            sizeof(char*) * (curr_word_set->words_alloc),
-            sizeof(char*) * new_size);
+        memcpy(new_words, curr_word_set->words, sizeof(char*) * curr_word_set->words_len);
 
+        curr_word_set->words = new_words;
         curr_word_set->words_alloc = new_size;
     }
 
@@ -354,34 +364,8 @@ void register_word_set(const char *name, const char *word)
 
 
 void input_quit()
-{
-    char_set *curr_char_set = root_char_set;
-    char_set *next_char_set;
-
-    while (curr_char_set != NULL)
-    {
-        next_char_set = curr_char_set->next;
-
-        free(curr_char_set);
-
-        curr_char_set = next_char_set;
-    }
-
+{   // the sets themselves live in load_arena.
     root_char_set = NULL;
-
-    word_set *curr_word_set = root_word_set;
-    word_set *next_word_set;
-
-    while (curr_word_set != NULL)
-    {
-        next_word_set = curr_word_set->next;
-
-        free(curr_word_set->words);
-        free(curr_word_set);
-
-        curr_word_set = next_word_set;
-    }
-
     root_word_set = NULL;
 }
 
@@ -638,6 +622,14 @@ void input_set_state(const char *buff, size_t buff_len)
 }
 
 
+const char *input_current_text(size_t *cursor)
+{   // the text being entered and where the cursor is, for the status page.
+    *cursor = current_offset;
+
+    return input_text;
+}
+
+
 void input_get_state(char *buff, size_t buff_len)
 {
     if (buff_len > 0)
@@ -39,6 +39,112 @@
 #include <stdio.h>
 #include <string.h>
 
+// What the fake devices have to support, worked out from the finalised configs.
+static Uint8 keyboard_keys[(KEY_MAX + 8) / 8];
+static bool keyboard_wants_mouse = false;
+static bool keyboard_wants_wheel = false;
+static bool keyboard_wants_absolute = false;
+
+
+void keyboard_need_key(int keycode)
+{
+    if (keycode <= 0 || keycode > KEY_MAX)
+        return;
+
+    if (keycode == BTN_GEAR_UP || keycode == BTN_GEAR_DOWN)
+    {   // these get turned into wheel movement.
+        keyboard_wants_wheel = true;
+        return;
+    }
+
+    if (keycode >= BTN_MOUSE && keycode <= BTN_TASK)
+        keyboard_wants_mouse = true;
+
+    keyboard_keys[keycode / 8] |= (1 << (keycode % 8));
+}
+
+
+static void keyboard_scan_configs()
+{   // only ask for what something can actually send.
+    bool text_input = false;
+
+    for (const gptokeyb_config *current = root_config; current != NULL; current = current->next)
+    {
+        if (current->dpad_as_mouse == MOUSE_MOVEMENT_ON ||
+            current->left_analog_as_mouse == MOUSE_MOVEMENT_ON ||
+            current->right_analog_as_mouse == MOUSE_MOVEMENT_ON)
+            keyboard_wants_mouse = true;
+
+        if (current->left_analog_as_absolute_mouse == MOUSE_MOVEMENT_ON ||
+            current->right_analog_as_absolute_mouse == MOUSE_MOVEMENT_ON)
+            keyboard_wants_absolute = true;
+
+        if (current->charset != NULL || current->wordset != NULL)
+            text_input = true;
+
+        for (int btn=0; btn < GBTN_MAX; btn++)
+        {
+            const gptokeyb_button *button = &current->button[btn];
+
+            keyboard_need_key(button->keycode);
+
+            if ((button->modifier & MOD_SHIFT) != 0)
+                keyboard_need_key(KEY_LEFTSHIFT);
+
+            if ((button->modifier & MOD_CTRL) != 0)
+                keyboard_need_key(KEY_LEFTCTRL);
+
+            if ((button->modifier & MOD_ALT) != 0)
+                keyboard_need_key(KEY_LEFTALT);
+
+            if (button->action == ACT_SPECIAL && button->special >= SPC_ADD_LETTER)
+                text_input = true;
+        }
+    }
+
+    if (text_input)
+        input_need_keys();
+
+    if (want_pc_quit)
+    {
+        keyboard_need_key(KEY_LEFTALT);
+        keyboard_need_key(KEY_F4);
+    }
+}
+
+
+void keyboard_need_everything()
+{   // the daemon has to cope with configs it hasn't seen yet.
+    for (int keycode=1; keycode < BTN_MISC; keycode++)
+        keyboard_need_key(keycode);
+
+    for (int keycode=BTN_MOUSE; keycode <= BTN_TASK; keycode++)
+        keyboard_need_key(keycode);
+
+    // every KEY_* name can be bound, but joystick style buttons would make the keyboard look like a gamepad.
+    for (int keycode=KEY_OK; keycode <= KEY_MAX; keycode++)
+    {
+        if (keycode >= BTN_DPAD_UP && keycode <= BTN_DPAD_RIGHT)
+            continue;
+
+        if (keycode >= BTN_TRIGGER_HAPPY && keycode <= BTN_TRIGGER_HAPPY40)
+            continue;
+
+        keyboard_need_key(keycode);
+    }
+
+    keyboard_wants_mouse = true;
+    keyboard_wants_wheel = true;
+    keyboard_wants_absolute = true;
+}
+
+
+bool keyboard_needs_absolute_mouse()
+{
+    return keyboard_wants_absolute;
+}
+
+
 void setupFakeAbsoluteMouseDevice()
 {
     struct uinput_user_dev device;
@@ -110,25 +216,45 @@ void setupFakeKeyboardMouseDevice()
         exit(255);
     }
 
-    for (int i = 0; i < 256; i++)
-    {
-        ioctl(fd, UI_SET_KEYBIT, i);
-    }
+    keyboard_scan_configs();
 
     if (
         // Keys or Buttons
         ioctl(fd, UI_SET_EVBIT, EV_SYN) ||
-        ioctl(fd, UI_SET_EVBIT, EV_KEY) ||
+        ioctl(fd, UI_SET_EVBIT, EV_KEY)
+        ) {
+        fprintf(stderr, "One of the keyboard/mouse ioctls failed: %s\n", strerror(errno));
+        exit(255);
+    }
+
+    // only the keys the configs use.
+    for (int keycode = 1; keycode <= KEY_MAX; keycode++)
+    {
+        if ((keyboard_keys[keycode / 8] & (1 << (keycode % 8))) == 0)
+            continue;
 
-        // Fake mouse for both absolute and relative positioning
+        if (ioctl(fd, UI_SET_KEYBIT, keycode))
+        {
+            fprintf(stderr, "Unable to enable key %d: %s\n", keycode, strerror(errno));
+            exit(255);
+        }
+    }
+
+    // Fake mouse for relative positioning, it needs the buttons to be seen as a mouse.
+    if ((keyboard_wants_mouse || keyboard_wants_wheel) && (
         ioctl(fd, UI_SET_EVBIT, EV_REL) ||
         ioctl(fd, UI_SET_RELBIT, REL_X) ||
         ioctl(fd, UI_SET_RELBIT, REL_Y) ||
         ioctl(fd, UI_SET_KEYBIT, BTN_LEFT) ||
-        ioctl(fd, UI_SET_KEYBIT, BTN_RIGHT) ||
-        // FUCKING SCHROLL WHEEL
-        ioctl(fd, UI_SET_RELBIT, REL_WHEEL)
-        ) {
+        ioctl(fd, UI_SET_KEYBIT, BTN_RIGHT)
+        )) {
+        fprintf(stderr, "One of the keyboard/mouse ioctls failed: %s\n", strerror(errno));
+        exit(255);
+    }
+
+    // FUCKING SCHROLL WHEEL
+    if (keyboard_wants_wheel && ioctl(fd, UI_SET_RELBIT, REL_WHEEL))
+    {
         fprintf(stderr, "One of the keyboard/mouse ioctls failed: %s\n", strerror(errno));
         exit(255);
     }
@@ -221,21 +221,71 @@ const keyboard_values keyboard_codes[] = {
 };
 
 
+#include "keys_gen.h"
+
+// if this fails keys_gen.h is out of date.
+typedef char keyboard_codes_count_check[((sizeof(keyboard_codes) / sizeof(keyboard_codes[0])) == KEYBOARD_CODES_COUNT) ? 1 : -1];
+
+
+static Uint32 keys_hash(const char *key, Uint32 seed, bool fold)
+{   // FNV-1a, has to match tools/genkeys.py
+    Uint32 hash = 2166136261u ^ seed;
+
+    for (; *key != '\0'; key++)
+    {
+        Uint8 c = (Uint8)*key;
+
+        if (fold && c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+
+        hash ^= c;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+static int keys_lookup(const char *key, bool fold, const Uint16 *displace, int buckets, const Sint16 *slots, int size)
+{   // perfect hash lookup, returns a table index that still has to be compared, or -1.
+    Uint32 seed = displace[keys_hash(key, 0, fold) % buckets];
+
+    return slots[keys_hash(key, seed, fold) % size];
+}
+
+
+static const keyboard_values *keyboard_entry(int index)
+{   // the generated extra names come after keyboard_codes.
+    if (index < KEYBOARD_CODES_COUNT)
+        return &keyboard_codes[index];
+
+    return &keyboard_codes_extra[index - KEYBOARD_CODES_COUNT];
+}
+
 
 const keyboard_values *find_keyboard(const char *key)
 {
-    int num_pairs = sizeof(keyboard_codes) / sizeof(keyboard_codes[0]);
+    const keyboard_values *result;
+    int index;
+
+    index = keys_lookup(key, false, keyboard_exact_displace, KEYBOARD_EXACT_BUCKETS, keyboard_exact_slots, KEYBOARD_EXACT_SIZE);
 
-    for (int i=0; i < num_pairs; i++)
+    if (index >= 0)
     {
-        if (strcmp(key, keyboard_codes[i].str) == 0)
-            return &keyboard_codes[i];
+        result = keyboard_entry(index);
+
+        if (strcmp(key, result->str) == 0)
+            return result;
     }
 
-    for (int i=0; i < num_pairs; i++)
+    index = keys_lookup(key, true, keyboard_folded_displace, KEYBOARD_FOLDED_BUCKETS, keyboard_folded_slots, KEYBOARD_FOLDED_SIZE);
+
+    if (index >= 0)
     {
-        if (strcasecmp(key, keyboard_codes[i].str) == 0)
-            return &keyboard_codes[i];
+        result = keyboard_entry(index);
+
+        if (strcasecmp(key, result->str) == 0)
+            return result;
     }
 
     return NULL;
@@ -244,15 +294,10 @@ const keyboard_values *find_keyboard(const char *key)
 
 const char *find_keycode(short keycode)
 {
-    int num_pairs = sizeof(keyboard_codes) / sizeof(keyboard_codes[0]);
+    if (keycode < 0 || keycode >= KEYCODE_NAMES_COUNT || keycode_index[keycode] < 0)
+        return "(null)";
 
-    for (int i=0; i < num_pairs; i++)
-    {
-        if (keycode == keyboard_codes[i].keycode)
-            return keyboard_codes[i].str;
-    }
-
-    return "(null)";
+    return keyboard_entry(keycode_index[keycode])->str;
 }
 
 const button_match button_codes[] = {
@@ -307,13 +352,10 @@ void set_hotkey(int gbtn)
 
 const button_match *find_button(const char *key)
 {
-    int num_pairs = sizeof(button_codes) / sizeof(button_codes[0]);
+    int index = keys_lookup(key, true, button_folded_displace, BUTTON_FOLDED_BUCKETS, button_folded_slots, BUTTON_FOLDED_SIZE);
 
-    for (int i=0; i < num_pairs; i++)
-    {
-        if (strcasecmp(key, button_codes[i].str) == 0)
-            return &button_codes[i];
-    }
+    if (index >= 0 && strcasecmp(key, button_codes[index].str) == 0)
+        return &button_codes[index];
 
     if (strcasecmp(key, button_hotkey.str) == 0)
     {
@@ -0,0 +1,411 @@
+/* Copyright (c) 2021-2024
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 2 of the License, or (at your option) any later version.
+#
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+#
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA 02110-1301 USA
+#
+* Authored by: Kris Henriksen <krishenriksen.work@gmail.com>
+#
+* AnberPorts-Keyboard-Mouse
+*
+* Part of the code is from from https://github.com/krishenriksen/AnberPorts/blob/master/AnberPorts-Keyboard-Mouse/main.c (mostly the fake keyboard)
+* Fake Xbox code from: https://github.com/Emanem/js2xbox
+*
+* Modified (badly) by: Shanti Gilbert for EmuELEC
+* Modified further by: Nikolai Wuttke for EmuELEC (Added support for SDL and the SDLGameControllerdb.txt)
+* Modified further by: Jacob Smith
+*
+* Any help improving this code would be greatly appreciated!
+*
+* DONE: Xbox360 mode: Fix triggers so that they report from 0 to 255 like real Xbox triggers
+*       Xbox360 mode: Figure out why the axis are not correctly labeled?  SDL_CONTROLLER_AXIS_RIGHTX / SDL_CONTROLLER_AXIS_RIGHTY / SDL_CONTROLLER_AXIS_TRIGGERLEFT / SDL_CONTROLLER_AXIS_TRIGGERRIGHT
+*       Keyboard mode: Add a config file option to load mappings from.
+*       add L2/R2 triggers
+*
+*/
+
+#include "gptokeyb2.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+#define LOOP_MAX_FDS (MAX_CONTROLLERS + 16)
+#define LOOP_MAX_EVENTS 16
+#define LOOP_MAX_WATCHES 12
+
+/* The loop is used when we aren't pumping SDL for input, everything we wait
+ * on is a file descriptor, so the whole main loop becomes one epoll_wait().
+ */
+
+typedef struct
+{
+    int fd;
+    loop_callback callback;
+    void *data;
+} loop_entry;
+
+static loop_entry loop_entries[LOOP_MAX_FDS];
+static int loop_epoll_fd = -1;
+static int loop_signal_fd = -1;
+
+/* When SDL is pumping the events a thread polls the watched fds instead, and
+ * wakes SDL_WaitEvent() with an event. The callbacks still run on the main
+ * thread from loop_handle_event(), the thread waits until they are done.
+ */
+static loop_entry loop_watches[LOOP_MAX_WATCHES];
+static SDL_mutex *loop_watch_lock = NULL;
+static SDL_sem *loop_watch_handled = NULL;
+static Uint32 loop_watch_event = (Uint32)-1;
+static int loop_wake_fds[2] = {-1, -1};
+
+
+static void loop_signal_callback(int fd, void *data)
+{
+    struct signalfd_siginfo info;
+    (void)data;
+
+    while (read(fd, &info, sizeof(info)) == sizeof(info))
+    {
+        printf("Caught signal %" PRIu32 ", quitting.\n", info.ssi_signo);
+        current_state.running = false;
+    }
+}
+
+
+bool loop_init()
+{
+    sigset_t mask;
+
+    for (int i=0; i < LOOP_MAX_FDS; i++)
+        loop_entries[i].fd = -1;
+
+    loop_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop_epoll_fd < 0)
+    {
+        fprintf(stderr, "Unable to create epoll fd: %s\n", strerror(errno));
+        return false;
+    }
+
+    // SDL normally turns these into SDL_QUIT, but nobody is pumping SDL events.
+    // This has to happen before SDL starts any threads so they inherit the mask.
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    SDL_SetHint(SDL_HINT_NO_SIGNAL_HANDLERS, "1");
+
+    loop_signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (loop_signal_fd < 0)
+    {
+        fprintf(stderr, "Unable to create signal fd: %s\n", strerror(errno));
+        return false;
+    }
+
+    return loop_add_fd(loop_signal_fd, loop_signal_callback, NULL);
+}
+
+
+void loop_quit()
+{
+    sigset_t mask;
+
+    if (loop_signal_fd >= 0)
+    {
+        loop_remove_fd(loop_signal_fd);
+        close(loop_signal_fd);
+        loop_signal_fd = -1;
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+
+    if (loop_epoll_fd >= 0)
+    {
+        close(loop_epoll_fd);
+        loop_epoll_fd = -1;
+    }
+}
+
+
+bool loop_add_fd(int fd, loop_callback callback, void *data)
+{
+    struct epoll_event event;
+
+    for (int i=0; i < LOOP_MAX_FDS; i++)
+    {
+        if (loop_entries[i].fd != -1)
+            continue;
+
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u32 = (uint32_t)i;
+
+        if (epoll_ctl(loop_epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+        {
+            fprintf(stderr, "Unable to watch fd %d: %s\n", fd, strerror(errno));
+            return false;
+        }
+
+        loop_entries[i].fd = fd;
+        loop_entries[i].callback = callback;
+        loop_entries[i].data = data;
+        return true;
+    }
+
+    fprintf(stderr, "Unable to watch fd %d: too many fds.\n", fd);
+    return false;
+}
+
+
+void loop_remove_fd(int fd)
+{
+    for (int i=0; i < LOOP_MAX_FDS; i++)
+    {
+        if (loop_entries[i].fd != fd)
+            continue;
+
+        epoll_ctl(loop_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+        loop_entries[i].fd = -1;
+        loop_entries[i].callback = NULL;
+        loop_entries[i].data = NULL;
+        return;
+    }
+}
+
+
+void loop_wait(Sint32 timeout)
+{   // wait for any of our fds, or until timeout ms have passed (-1 waits forever).
+    struct epoll_event events[LOOP_MAX_EVENTS];
+
+    int count = epoll_wait(loop_epoll_fd, events, LOOP_MAX_EVENTS, timeout);
+
+    if (count < 0)
+    {
+        if (errno != EINTR)
+            fprintf(stderr, "epoll_wait() failed: %s\n", strerror(errno));
+
+        return;
+    }
+
+    for (int i=0; i < count; i++)
+    {
+        loop_entry *entry = &loop_entries[events[i].data.u32];
+
+        // it may have been removed by an earlier callback
+        if (entry->fd == -1)
+            continue;
+
+        entry->callback(entry->fd, entry->data);
+    }
+}
+
+
+static int loop_watch_thread(void *data)
+{   // only waits, the main thread does the work so nothing else has to be thread safe.
+    struct pollfd poll_fds[LOOP_MAX_WATCHES + 1];
+    int slots[LOOP_MAX_WATCHES + 1];
+    SDL_Event event;
+    (void)data;
+
+    for (;;)
+    {
+        int count = 0;
+
+        poll_fds[count].fd = loop_wake_fds[0];
+        poll_fds[count].events = POLLIN;
+        poll_fds[count].revents = 0;
+        slots[count++] = -1;
+
+        SDL_LockMutex(loop_watch_lock);
+
+        for (int i=0; i < LOOP_MAX_WATCHES; i++)
+        {
+            if (loop_watches[i].fd == -1)
+                continue;
+
+            poll_fds[count].fd = loop_watches[i].fd;
+            poll_fds[count].events = POLLIN;
+            poll_fds[count].revents = 0;
+            slots[count++] = i;
+        }
+
+        SDL_UnlockMutex(loop_watch_lock);
+
+        if (poll(poll_fds, count, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        if (poll_fds[0].revents != 0)
+        {   // the watch list changed.
+            char buffer[16];
+
+            while (read(loop_wake_fds[0], buffer, sizeof(buffer)) > 0)
+                ;
+        }
+
+        for (int i=1; i < count; i++)
+        {
+            if ((poll_fds[i].revents & POLLIN) == 0)
+                continue;
+
+            memset(&event, 0, sizeof(event));
+            event.type = loop_watch_event;
+            event.user.code = slots[i];
+            event.user.data1 = (void *)(intptr_t)poll_fds[i].fd;
+
+            if (SDL_PushEvent(&event) != 1)
+                return 0;
+
+            SDL_SemWait(loop_watch_handled);
+        }
+    }
+
+    return 0;
+}
+
+
+static bool loop_watch_start()
+{   // the first watch starts the thread.
+    if (loop_watch_lock != NULL)
+        return true;
+
+    if (pipe(loop_wake_fds) < 0)
+    {
+        fprintf(stderr, "Unable to create the watch pipe: %s\n", strerror(errno));
+        return false;
+    }
+
+    fcntl(loop_wake_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(loop_wake_fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(loop_wake_fds[1], F_SETFL, O_NONBLOCK);
+    fcntl(loop_wake_fds[1], F_SETFD, FD_CLOEXEC);
+
+    for (int i=0; i < LOOP_MAX_WATCHES; i++)
+        loop_watches[i].fd = -1;
+
+    loop_watch_event = SDL_RegisterEvents(1);
+    loop_watch_handled = SDL_CreateSemaphore(0);
+    loop_watch_lock = SDL_CreateMutex();
+
+    SDL_Thread *thread = NULL;
+
+    if (loop_watch_event != (Uint32)-1 && loop_watch_handled != NULL && loop_watch_lock != NULL)
+        thread = SDL_CreateThread(loop_watch_thread, "gptk_watch", NULL);
+
+    if (thread == NULL)
+    {
+        fprintf(stderr, "Unable to start the watch thread: %s\n", SDL_GetError());
+        return false;
+    }
+
+    SDL_DetachThread(thread);
+
+    return true;
+}
+
+
+static void loop_watch_wake()
+{
+    char wake = 1;
+
+    if (write(loop_wake_fds[1], &wake, 1) < 0 && errno != EAGAIN)
+        fprintf(stderr, "Unable to wake the watch thread: %s\n", strerror(errno));
+}
+
+
+bool loop_watch_fd(int fd, loop_callback callback, void *data)
+{   // like loop_add_fd(), but also works when SDL is pumping the events.
+    if (evdev_mode)
+        return loop_add_fd(fd, callback, data);
+
+    if (!loop_watch_start())
+        return false;
+
+    SDL_LockMutex(loop_watch_lock);
+
+    for (int i=0; i < LOOP_MAX_WATCHES; i++)
+    {
+        if (loop_watches[i].fd != -1)
+            continue;
+
+        loop_watches[i].fd = fd;
+        loop_watches[i].callback = callback;
+        loop_watches[i].data = data;
+
+        SDL_UnlockMutex(loop_watch_lock);
+        loop_watch_wake();
+        return true;
+    }
+
+    SDL_UnlockMutex(loop_watch_lock);
+
+    fprintf(stderr, "Unable to watch fd %d: too many fds.\n", fd);
+    return false;
+}
+
+
+void loop_unwatch_fd(int fd)
+{
+    if (evdev_mode)
+    {
+        loop_remove_fd(fd);
+        return;
+    }
+
+    if (loop_watch_lock == NULL)
+        return;
+
+    SDL_LockMutex(loop_watch_lock);
+
+    for (int i=0; i < LOOP_MAX_WATCHES; i++)
+    {
+        if (loop_watches[i].fd != fd)
+            continue;
+
+        loop_watches[i].fd = -1;
+        loop_watches[i].callback = NULL;
+        loop_watches[i].data = NULL;
+    }
+
+    SDL_UnlockMutex(loop_watch_lock);
+    loop_watch_wake();
+}
+
+
+bool loop_handle_event(const SDL_Event *event)
+{   // runs the callback for a watched fd, true if the event was ours.
+    if (loop_watch_event == (Uint32)-1 || event->type != loop_watch_event)
+        return false;
+
+    int slot = event->user.code;
+    int fd = (int)(intptr_t)event->user.data1;
+
+    // it may have been unwatched since.
+    if (slot >= 0 && slot < LOOP_MAX_WATCHES && loop_watches[slot].fd == fd)
+        loop_watches[slot].callback(fd, loop_watches[slot].data);
+
+    SDL_SemPost(loop_watch_handled);
+
+    return true;
+}
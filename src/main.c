@@ -37,9 +37,16 @@
 
 #include "gptokeyb2.h"
 #include <linux/uinput.h>
+#include <getopt.h>
 #include <stdbool.h>
+#include <time.h>
+#include <sys/timerfd.h>
 
-#define MAX_PROCESS_NAME 64
+// longest gap a single mouse step will make up for after a stall, in ticks.
+#define MOUSE_MAX_TICKS 4
+
+// session_start() is happy for the program to keep going.
+#define SESSION_RUN -1
 
 #ifndef MAX_PATH
 #define MAX_PATH 1024
@@ -52,6 +59,8 @@ int abs_uinp_fd = 0; // fake absolute position mouse
 
 bool xbox360_mode=false;
 bool config_mode=false;
+bool evdev_mode=false;
+bool daemon_mode=false;
 
 bool want_pc_quit = false;
 bool want_kill = false;
@@ -65,20 +74,349 @@ char kill_process_name[MAX_PROCESS_NAME] = "";
 
 gptokeyb_config *default_config=NULL;
 
+// the mouse is moved from a periodic timerfd, scaled by the time that actually passed.
+static int mouse_timer_fd = -1;
+static bool mouse_timer_fired = false;
+static float mouse_remainder_x = 0.0f;
+static float mouse_remainder_y = 0.0f;
 
 
-int main(int argc, char* argv[])
+static Sint32 ticks_until(Uint32 current_ticks, Uint32 deadline)
+{   // milliseconds until deadline, 0 if it has already passed.
+    if (SDL_TICKS_PASSED(current_ticks, deadline))
+        return 0;
+
+    return (Sint32)(deadline - current_ticks);
+}
+
+
+static double monotonic_ms()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1000000.0;
+}
+
+
+// --startup-trace, the marks are always taken and only printed if asked for.
+#define STARTUP_TRACE_MAX 24
+
+static struct
+{
+    const char *phase;
+    double ms;
+    double at;
+} startup_trace[STARTUP_TRACE_MAX];
+
+static int startup_trace_count = 0;
+static double startup_trace_start = 0.0;
+static double startup_trace_last = 0.0;
+
+
+static void startup_mark(const char *phase)
+{   // the time since the previous mark is put down to this phase, repeats add up under one key.
+    double now = monotonic_ms();
+    double ms = now - startup_trace_last;
+
+    startup_trace_last = now;
+
+    for (int i=0; i < startup_trace_count; i++)
+    {
+        if (strcmp(startup_trace[i].phase, phase) == 0)
+        {
+            startup_trace[i].ms += ms;
+            startup_trace[i].at = now;
+            return;
+        }
+    }
+
+    if (startup_trace_count >= STARTUP_TRACE_MAX)
+        return;
+
+    startup_trace[startup_trace_count].phase = phase;
+    startup_trace[startup_trace_count].ms = ms;
+    startup_trace[startup_trace_count].at = now;
+    startup_trace_count++;
+}
+
+
+static void startup_trace_print()
+{
+    for (int i=0; i < startup_trace_count; i++)
+    {
+        fprintf(stderr, "startup: %-16s %9.3f ms  (at %9.3f ms)\n",
+            startup_trace[i].phase,
+            startup_trace[i].ms,
+            startup_trace[i].at - startup_trace_start);
+    }
+
+    // and all on one line for scripts, each key only once.
+    fprintf(stderr, "startup_trace");
+
+    for (int i=0; i < startup_trace_count; i++)
+        fprintf(stderr, " %s=%.3f", startup_trace[i].phase, startup_trace[i].ms);
+
+    fprintf(stderr, " total=%.3f\n", startup_trace_last - startup_trace_start);
+}
+
+
+static void mouse_timer_set(Uint64 interval)
+{   // start the periodic mouse tick, 0 stops it.
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.it_interval.tv_sec  = interval / 1000;
+    spec.it_interval.tv_nsec = (interval % 1000) * 1000000;
+    spec.it_value = spec.it_interval;
+
+    timerfd_settime(mouse_timer_fd, 0, &spec, NULL);
+    mouse_timer_fired = false;
+}
+
+
+static bool mouse_timer_check()
+{   // consumes any pending expirations, true if the tick is due.
+    Uint64 expirations = 0;
+
+    if (read(mouse_timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations) && expirations > 0)
+        mouse_timer_fired = true;
+
+    bool fired = mouse_timer_fired;
+    mouse_timer_fired = false;
+
+    return fired;
+}
+
+
+static Sint32 mouse_timer_timeout()
+{   // milliseconds until the next tick, -1 if the timer is stopped.
+    struct itimerspec spec;
+
+    if (timerfd_gettime(mouse_timer_fd, &spec) < 0)
+        return -1;
+
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+        return -1;
+
+    // round up so we don't wake up just before it fires.
+    return (Sint32)(spec.it_value.tv_sec * 1000 + (spec.it_value.tv_nsec + 999999) / 1000000);
+}
+
+
+static void mouse_timer_callback(int fd, void *data)
+{
+    Uint64 expirations = 0;
+    (void)data;
+
+    if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations) && expirations > 0)
+        mouse_timer_fired = true;
+}
+
+
+static bool mouse_motion_update(float slow_scale, float step_scale)
+{   // emit one step of mouse movement, step_scale is how many mouse_delay periods it covers. returns true if the mouse moved.
+    int mouse_x=0;
+    int mouse_y=0;
+    bool mouse_moved=false;
+    vector2d mouse_move;
+
+    if (current_state.mouse_relative_x != 0 ||
+        current_state.mouse_relative_y != 0 ||
+        current_dpad_as_mouse)
+    {
+        float move_x = (float)current_state.mouse_relative_x;
+        float move_y = (float)current_state.mouse_relative_y;
+
+        if (current_dpad_as_mouse > 0)
+        {
+            vector2d_clear(&mouse_move);
+
+            mouse_move.x -= (is_pressed(GBTN_DPAD_LEFT ) ? 1.0f : 0.0f);
+            mouse_move.x += (is_pressed(GBTN_DPAD_RIGHT) ? 1.0f : 0.0f);
+            mouse_move.y -= (is_pressed(GBTN_DPAD_UP   ) ? 1.0f : 0.0f);
+            mouse_move.y += (is_pressed(GBTN_DPAD_DOWN ) ? 1.0f : 0.0f);
+
+            if (current_state.dpad_mouse_normalize)
+                vector2d_normalize(&mouse_move);
+
+            move_x += mouse_move.x * current_state.dpad_mouse_step;
+            move_y += mouse_move.y * current_state.dpad_mouse_step;
+        }
+
+        if (current_state.mouse_slow)
+        {
+            move_x /= slow_scale;
+            move_y /= slow_scale;
+        }
+
+        // keep the fractions so slow movement and short ticks don't get lost.
+        move_x = move_x * step_scale + mouse_remainder_x;
+        move_y = move_y * step_scale + mouse_remainder_y;
+
+        mouse_x = (int)move_x;
+        mouse_y = (int)move_y;
+
+        mouse_remainder_x = move_x - (float)mouse_x;
+        mouse_remainder_y = move_y - (float)mouse_y;
+
+        emitRelativeMouseMotion(mouse_x, mouse_y);
+
+        if (move_x != 0.0f || move_y != 0.0f) {
+            mouse_moved=true;
+            GPTK2_DEBUG("relative mouse move %d %d\n", mouse_x, mouse_y);
+        }
+    }
+
+    if (!mouse_moved)
+    {
+        mouse_remainder_x = 0.0f;
+        mouse_remainder_y = 0.0f;
+    }
+
+    if (current_state.mouse_absolute_x != 0 || current_state.mouse_absolute_y != 0)
+    {
+        if (current_state.absolute_rotate == 90) {
+            mouse_x = current_state.absolute_center_x + (current_state.absolute_step * -current_state.mouse_absolute_y / INT16_MAX);
+            mouse_y = current_state.absolute_center_y + (current_state.absolute_step * current_state.mouse_absolute_x / INT16_MAX);
+        }
+        else if (current_state.absolute_rotate == 180) { 
+            mouse_x = current_state.absolute_center_x + (current_state.absolute_step * -current_state.mouse_absolute_x / INT16_MAX);
+            mouse_y = current_state.absolute_center_y + (current_state.absolute_step * -current_state.mouse_absolute_y / INT16_MAX);
+        }
+        else if (current_state.absolute_rotate == 270) {
+            mouse_x = current_state.absolute_center_x + (current_state.absolute_step * current_state.mouse_absolute_y / INT16_MAX);
+            mouse_y = current_state.absolute_center_y + (current_state.absolute_step * -current_state.mouse_absolute_x / INT16_MAX);
+        }
+        else {
+            mouse_x = current_state.absolute_center_x + (current_state.absolute_step * current_state.mouse_absolute_x / INT16_MAX);
+            mouse_y = current_state.absolute_center_y + (current_state.absolute_step * current_state.mouse_absolute_y / INT16_MAX);
+        }
+        
+        if (abs(mouse_x - current_state.absolute_center_x) > current_state.absolute_deadzone ||
+            abs(mouse_y - current_state.absolute_center_y) > current_state.absolute_deadzone) {
+            
+            emitAbsoluteMouseMotion(mouse_x, mouse_y);
+            mouse_moved=true;
+        }
+    }
+
+    return mouse_moved;
+}
+
+
+// what this invocation was asked to do, session_start() fills these in.
+static bool do_dump_config = false;
+static bool do_compile_config = false;
+static bool do_startup_trace = false;
+static bool do_release = false;
+static bool do_watch = false;
+static bool do_control = false;
+static bool do_status = false;
+static bool do_exec = false;
+static int config_files = 0;
+
+// with --exec the program and its arguments start here in argv.
+static int program_index = 0;
+
+// set when a daemon client has loaded new configs, the main loop picks up the new mouse settings.
+static bool session_changed = false;
+
+// a daemon with nothing to run.
+static char *session_idle_argv[] = {"gptokeyb2", NULL};
+
+// the arguments of the running session, --watch loads them again.
+static int session_argc = 0;
+static char **session_argv = NULL;
+
+bool session_ended = false;
+
+
+static void session_init()
 {
-    bool do_dump_config = false;
+    load_arena = arena_create();
 
     string_init();
     state_init();
     config_init();
     input_init();
+}
 
-    xbox_uinp_fd = 0;
-    kb_uinp_fd = 0;
-    abs_uinp_fd = 0;
+
+static void session_free()
+{
+    config_quit();
+    state_quit();
+    input_quit();
+    string_quit();
+    arena_destroy(load_arena);
+}
+
+
+static void session_forget_args()
+{
+    for (int i=0; i < session_argc; i++)
+        free(session_argv[i]);
+
+    free(session_argv);
+
+    session_argc = 0;
+    session_argv = NULL;
+}
+
+
+static void session_keep_args(int argc, char* argv[])
+{
+    char **copy = (char **)gptk_malloc(sizeof(char *) * (argc + 1));
+
+    for (int i=0; i < argc; i++)
+        copy[i] = strdup(argv[i]);
+
+    copy[argc] = NULL;
+
+    session_forget_args();
+
+    session_argc = argc;
+    session_argv = copy;
+}
+
+
+static int session_start(int argc, char* argv[])
+{   // read the environment and arguments, load the configs. returns SESSION_RUN or an exit code.
+    int opt;
+    char default_control[MAX_CONTROL_NAME] = "";
+
+    static const struct option long_options[] = {
+        {"compile", no_argument, NULL, 'C'},
+        {"control", no_argument, NULL, 'K'},
+        {"daemon", no_argument, NULL, 'D'},
+        {"exec", no_argument, NULL, 'E'},
+        {"release", no_argument, NULL, 'R'},
+        {"send", required_argument, NULL, 'S'},
+        {"status", no_argument, NULL, 'U'},
+        {"startup-trace", no_argument, NULL, 'T'},
+        {"watch", no_argument, NULL, 'W'},
+        {NULL, 0, NULL, 0},
+    };
+
+    // the daemon runs this once per client.
+    xbox360_mode = false;
+    config_mode = false;
+
+    want_pc_quit = false;
+    want_kill = false;
+    want_sudo = false;
+
+    game_prefix[0] = '\0';
+    kill_process_name[0] = '\0';
+
+    default_config = NULL;
+    do_release = false;
+    config_files = 0;
+    optind = 0;
+
+    reload_clear();
 
     char* env_home = SDL_getenv("HOME");
     if (env_home)
@@ -136,9 +474,6 @@ int main(int argc, char* argv[])
         want_kill = true;
     }
 
-    int opt;
-    char default_control[MAX_CONTROL_NAME] = "";
-
     // Fix some old gptokeyb settings.
     for (int k=0; k < argc; k++)
     {
@@ -148,7 +483,7 @@ int main(int argc, char* argv[])
         }
     }
 
-    while ((opt = getopt(argc, argv, "vk1g:hdxp:c:ZXPH:s:")) != -1)
+    while ((opt = getopt_long(argc, argv, "vk1eg:hdxp:c:ZXPH:s:", long_options, NULL)) != -1)
     {
         switch (opt)
         {
@@ -218,12 +553,52 @@ int main(int argc, char* argv[])
             strncpy(game_prefix, optarg, MAX_PROCESS_NAME - 1);
             break;
 
+        case 'C':
+        case 'D':
+        case 'E':
+        case 'K':
+        case 'S':
+        case 'U':
+        case 'W':
+            // handled in main.
+            break;
+
+        case 'R':
+            do_release = true;
+            break;
+
+        case 'T':
+            do_startup_trace = true;
+            break;
+
         case 'c':
-            config_load(optarg, false);
+            // options parsed so far, the loads below add up under a single key each.
+            startup_mark("options");
+
+            reload_add(optarg, false);
+
+            // only the first config can come from a compiled cache, the rest get layered on top.
+            if (config_files++ == 0)
+                cache_prepare(optarg);
+
+            if (config_files == 1 && !do_compile_config && cache_load())
+            {
+                startup_mark("config_cache");
+            }
+            else
+            {
+                config_load(optarg, false);
+                startup_mark("config_load");
+            }
+
             config_mode = true;
             xbox360_mode = false;
             break;
 
+        case 'e':
+            evdev_mode = true;
+            break;
+
         case 'x':
             config_mode = false;
             xbox360_mode = true;
@@ -248,7 +623,7 @@ int main(int argc, char* argv[])
                 fprintf(stderr, "\n");
             }
 
-            fprintf(stderr, "Usage: %s <program> [-dPXZ] [-H hotkey] [-c <config.ini>] [-p control_mode]\n",
+            fprintf(stderr, "Usage: %s <program> [-dePXZ] [-H hotkey] [-c <config.ini>] [-p control_mode]\n",
                 argv[0]);
             fprintf(stderr, "\n");
             fprintf(stderr, "Args:\n");
@@ -260,28 +635,42 @@ int main(int argc, char* argv[])
             fprintf(stderr, "  -x                  - xbox360 mode.\n");
             fprintf(stderr, "  -c  \"config.ini\"    - config file to load.\n");
             fprintf(stderr, "  -p  \"control\"       - what control mode to start in.\n");
+            fprintf(stderr, "  -e                  - read controllers with evdev directly instead of SDL.\n");
             fprintf(stderr, "\n");
             fprintf(stderr, "  -d                  - dump config parsed.\n");
+            fprintf(stderr, "  --compile           - compile the -c config to <config.ini>.cache for faster startup.\n");
+            fprintf(stderr, "  --startup-trace     - print how long each part of startup took.\n");
+            fprintf(stderr, "  --daemon            - keep the fake devices and take configs from later invocations.\n");
+            fprintf(stderr, "  --release           - tell the daemon to stop using the current config.\n");
+            fprintf(stderr, "  --watch             - load the configs again whenever they are saved.\n");
+            fprintf(stderr, "  --control           - take state commands on a control socket.\n");
+            fprintf(stderr, "  --send \"command\"    - send a command to a running --control and print the reply.\n");
+            fprintf(stderr, "  --status            - keep /dev/shm/gptokeyb2-<uid>.status up to date for frontends.\n");
+            fprintf(stderr, "  --exec              - start <program> ourselves, quit when it does. put -- before it if it takes options.\n");
             fprintf(stderr, "  -v                  - print version and quit.");
             fprintf(stderr, "\n");
             return 1;
             break;
 
         default:
-            config_quit();
-            state_quit();
-            input_quit();
-            string_quit();
-            exit(EXIT_FAILURE);
+            return EXIT_FAILURE;
             break;
         }
     }
 
+    program_index = optind;
+
     for (int index=optind, i=0; index < argc; index++, i++)
     {
         if (i == 0)
         {
-            strncpy(kill_process_name, argv[index], MAX_PROCESS_NAME - 1);
+            const char *program = argv[index];
+
+            // --exec gets a path, the prefix comes from the file name.
+            if (do_exec && strrchr(program, '/') != NULL)
+                program = strrchr(program, '/') + 1;
+
+            strncpy(kill_process_name, program, MAX_PROCESS_NAME - 1);
 
             if (strlen(game_prefix) == 0 && strlen(kill_process_name) > 0)
             {
@@ -312,21 +701,24 @@ int main(int argc, char* argv[])
         }
     }
 
+    startup_mark("options");
+
     if (config_mode)
     {
-        if (!do_dump_config && access(user_config_file, F_OK) == 0)
+        // watched even if it doesn't exist yet.
+        reload_add(user_config_file, true);
+
+        if (!do_dump_config && !do_compile_config && access(user_config_file, F_OK) == 0)
         // if (access(user_config_file, F_OK) == 0)
         {
             printf("Loading '%s'\n", user_config_file);
 
-            if (config_load(user_config_file, true))
-            {
-                config_quit();
-                state_quit();
-                input_quit();
-                string_quit();
+            bool failed = config_load(user_config_file, true);
+
+            startup_mark("user_config");
+
+            if (failed)
                 return 1;
-            }
         }
 
         if (strlen(default_control_name) > 0)
@@ -360,22 +752,286 @@ int main(int argc, char* argv[])
     config_finalise();
     state_change_update();
 
+    startup_mark("finalise");
+
+    return SESSION_RUN;
+}
+
+
+static void session_devices()
+{   // the daemon only makes the xbox controller once a client first asks for it.
+    if (!xbox360_mode)
+        return;
+
+    if (xbox_uinp_fd == 0)
+    {
+        printf("Running in Fake Xbox 360 Mode\n");
+        setupFakeXbox360Device();
+    }
+
+    // disable the fake mouse overlay configs
+    config_overlay_clear(root_config);
+    state_config_changed();
+}
+
+
+static int session_restart(int argc, char* argv[])
+{   // drop the running configs and load them again from argv, the devices and controllers stay.
+    output_queue_drain();
+    state_release();
+    emit_flush();
+
+    config_quit();
+    input_quit();
+    string_quit();
+    arena_destroy(load_arena);
+
+    load_arena = arena_create();
+    string_init();
+    state_reset();
+    config_init();
+    input_init();
+
+    session_changed = true;
+
+    // how we read the controllers was decided when the daemon started.
+    bool daemon_evdev_mode = evdev_mode;
+
+    int result = session_start(argc, argv);
+
+    evdev_mode = daemon_evdev_mode;
+
+    return result;
+}
+
+
+int session_switch(int argc, char* argv[])
+{   // drop whatever the daemon was doing and start again with a clients arguments.
+    session_keep_args(argc, argv);
+
+    int result = session_restart(session_argc, session_argv);
+
+    if (result == SESSION_RUN && !do_release)
+    {
+        if (strlen(kill_process_name) > 0)
+            printf("Watching '%s'\n", kill_process_name);
+
+        if (strlen(game_prefix) > 0)
+            printf("Game prefix '%s'\n", game_prefix);
+
+        session_devices();
+        return 0;
+    }
+
+    // nothing to run until the next client.
+    if (argv != session_idle_argv)
+        session_switch(1, session_idle_argv);
+
+    return (result == SESSION_RUN) ? 0 : result;
+}
+
+
+static void session_reload()
+{   // a watched config changed, load everything again and keep as much of the stack as still exists.
+    char names[CFG_STACK_MAX][MAX_CONTROL_NAME];
+    int depth = gptokeyb_config_depth;
+
+    if (!reload_check())
+        return;
+
+    for (int i=0; i <= depth; i++)
+    {
+        strncpy(names[i], config_stack[i]->name, MAX_CONTROL_NAME - 1);
+        names[i][MAX_CONTROL_NAME - 1] = '\0';
+    }
+
+    printf("Reloading configs.\n");
+
+    if (session_restart(session_argc, session_argv) != SESSION_RUN)
+    {   // these arguments worked before, so this is unlikely.
+        if (daemon_mode)
+            session_switch(1, session_idle_argv);
+        else
+            current_state.running = false;
+
+        return;
+    }
+
+    session_devices();
+
+    for (int i=0; i <= depth; i++)
+    {
+        gptokeyb_config *config = config_find(names[i]);
+
+        if (config == NULL)
+            break;
+
+        config_stack[i] = config;
+        gptokeyb_config_depth = i;
+    }
+
+    state_config_changed();
+}
+
+
+int main(int argc, char* argv[])
+{
+    bool local_only = false;
+
+    // these only mean something to the process that runs the session.
+    const char *session_option = NULL;
+
+    startup_trace_start = monotonic_ms();
+    startup_trace_last = startup_trace_start;
+
+    for (int k=0; k < argc; k++)
+    {
+        // the rest belong to the program.
+        if (strcmp(argv[k], "--") == 0)
+            break;
+
+        // has to be known before any -c is loaded.
+        if (strcmp(argv[k], "--compile") == 0)
+            do_compile_config = true;
+
+        else if (strcmp(argv[k], "--daemon") == 0)
+            daemon_mode = true;
+
+        else if (strcmp(argv[k], "--release") == 0)
+            do_release = true;
+
+        else if (strcmp(argv[k], "--watch") == 0)
+        {
+            do_watch = true;
+            session_option = argv[k];
+        }
+
+        else if (strcmp(argv[k], "--control") == 0)
+        {
+            do_control = true;
+            session_option = argv[k];
+        }
+
+        else if (strcmp(argv[k], "--status") == 0)
+        {
+            do_status = true;
+            session_option = argv[k];
+        }
+
+        else if (strcmp(argv[k], "--startup-trace") == 0)
+            session_option = argv[k];
+
+        // the daemon can't start programs for its clients.
+        else if (strcmp(argv[k], "--exec") == 0)
+            do_exec = true;
+
+        // nothing else is needed to talk to the control socket.
+        else if (strcmp(argv[k], "--send") == 0 && k + 1 < argc)
+            return control_send(argv[k + 1]);
+
+        // always answered by this process.
+        else if (strcmp(argv[k], "-d") == 0 || strcmp(argv[k], "-h") == 0 || strcmp(argv[k], "-v") == 0)
+            local_only = true;
+    }
+
+    if (daemon_mode && do_exec)
+    {
+        fprintf(stderr, "--exec can't be used with --daemon.\n");
+        return 1;
+    }
+
+    if (!daemon_mode && !do_compile_config && !do_exec && !local_only)
+    {   // if a daemon is running it does the work.
+        if (session_option != NULL && daemon_running())
+        {
+            fprintf(stderr, "%s can't be sent to a running daemon, start the daemon with it instead.\n", session_option);
+            return 1;
+        }
+
+        int result = daemon_client(argc, argv);
+
+        if (result >= 0)
+            return result;
+
+        if (do_release)
+            return 0;
+    }
+
+    session_init();
+
+    xbox_uinp_fd = 0;
+    kb_uinp_fd = 0;
+    abs_uinp_fd = 0;
+
+    startup_mark("init");
+
+    int session_result = session_start(argc, argv);
+
+    if (session_result != SESSION_RUN)
+    {
+        session_free();
+        return session_result;
+    }
+
+    if (do_startup_trace && (do_compile_config || do_dump_config))
+        startup_trace_print();
+
+    if (do_compile_config)
+    {
+        int result = 0;
+
+        if (config_files != 1)
+        {
+            fprintf(stderr, "--compile needs exactly one -c config.\n");
+            result = 1;
+        }
+        else if (!cache_save())
+        {
+            result = 1;
+        }
+
+        session_free();
+        return result;
+    }
+
     if (do_dump_config)
     {
         config_dump();
-        config_quit();
-        state_quit();
-        input_quit();
-        string_quit();
+        string_dump_stats();
+        session_free();
         return 0;
     }
 
+    if (do_exec && program_index >= argc)
+    {
+        fprintf(stderr, "--exec needs a program to run.\n");
+        session_free();
+        return 1;
+    }
+
     if (strlen(kill_process_name) > 0)
         printf("Watching '%s'\n", kill_process_name);
 
     if (strlen(game_prefix) > 0)
         printf("Game prefix '%s'\n", game_prefix);
 
+    session_keep_args(argc, argv);
+
+    // the loop has to block signals before SDL starts any threads.
+    if (do_exec)
+        child_prepare();
+
+    if (evdev_mode)
+    {
+        if (!loop_init())
+        {
+            fprintf(stderr, "Unable to setup the evdev event loop.\n");
+            return -1;
+        }
+
+        startup_mark("loop_init");
+    }
+
     // SDL initialization and main loop
     if (SDL_Init(SDL_INIT_GAMECONTROLLER | SDL_INIT_TIMER) != 0)
     {
@@ -383,128 +1039,240 @@ int main(int argc, char* argv[])
         return -1;
     }
 
+    startup_mark("sdl_init");
+
     const char* db_file = SDL_getenv("SDL_GAMECONTROLLERCONFIG_FILE");
     if (db_file)
     {
         SDL_GameControllerAddMappingsFromFile(db_file);
+        startup_mark("sdl_mappings");
     }
 
-    recordExistingControllers();
+    if (!evdev_mode)
+    {
+        recordExistingControllers();
+        startup_mark("controllers");
+    }
 
     // Create fake input devices
-    if (config_mode || xbox360_mode)
+    if (daemon_mode)
     {
+        // later clients can bind anything, so the daemon asks for everything up front.
+        keyboard_need_everything();
+        setupFakeKeyboardMouseDevice();
+        startup_mark("uinput_keyboard");
+
+        setupFakeAbsoluteMouseDevice();
+        startup_mark("uinput_absolute");
+
+        session_devices();
+    }
+    else if (config_mode || xbox360_mode)
+    {
+        // the configs can change under us, so anything they might bind has to be there.
+        if (do_watch)
+            keyboard_need_everything();
+
         // fake keyboard and mouse for any key input (and maybe mouse input)
         setupFakeKeyboardMouseDevice();
+        startup_mark("uinput_keyboard");
 
         if (xbox360_mode)
         {
             // seperately setup the fake xbox controller
             printf("Running in Fake Xbox 360 Mode\n");
             setupFakeXbox360Device();
+            startup_mark("uinput_xbox");
 
             // disable the fake mouse overlay configs
             config_overlay_clear(root_config);
+            state_config_changed();
         }
         else
         {
-            // or setup the absolute position mouse just in case
             printf("Running in Fake Keyboard mode\n");
-            setupFakeAbsoluteMouseDevice();
+
+            // and the absolute position mouse if any layer uses it
+            if (keyboard_needs_absolute_mouse())
+            {
+                setupFakeAbsoluteMouseDevice();
+                startup_mark("uinput_absolute");
+            }
+        }
+
+    }
+
+    // done after the fake devices exist so we can skip them.
+    if (evdev_mode)
+    {
+        if (!evdev_init())
+        {
+            evdev_mode = false;
+            loop_quit();
+            fprintf(stderr, "Falling back to SDL for controller input.\n");
+            recordExistingControllers();
         }
 
+        startup_mark("evdev_init");
+    }
+
+    if (daemon_mode)
+    {
+        if (!daemon_init())
+            return -1;
+
+        startup_mark("daemon_init");
+    }
+
+    if (do_watch && reload_init())
+        startup_mark("reload_init");
+
+    if (do_control && control_init())
+        startup_mark("control_init");
+
+    if (do_status && status_init())
+        startup_mark("status_init");
+
+    // last, so the program sees all of the fake devices.
+    if (do_exec)
+    {
+        if (!child_start(argc - program_index, argv + program_index))
+            return 1;
+
+        startup_mark("exec");
     }
 
     SDL_Event event;
-    int mouse_x=0;
-    int mouse_y=0;
-    bool mouse_moved=false;
-    vector2d mouse_move;
+    bool mouse_moving = false;
+    double last_mouse_tick = 0.0;
+    Uint64 mouse_tick = (current_state.mouse_tick > 0) ? current_state.mouse_tick : current_state.mouse_delay;
     float slow_scale = (100.0 / (float)(current_state.mouse_slow_scale));
 
+    mouse_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (mouse_timer_fd < 0)
+    {
+        fprintf(stderr, "Unable to create mouse timer: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (evdev_mode)
+        loop_add_fd(mouse_timer_fd, mouse_timer_callback, NULL);
+
+    startup_mark("ready");
+
+    if (do_startup_trace)
+        startup_trace_print();
+
     while (current_state.running)
     {
-        while (current_state.running && SDL_PollEvent(&event))
+        while (!evdev_mode && current_state.running && SDL_PollEvent(&event))
         {
             handleInputEvent(&event);
         }
 
-        mouse_x=0;
-        mouse_y=0;
-        mouse_moved = false;
-
         state_update();
 
-        if (current_state.mouse_relative_x != 0 ||
-            current_state.mouse_relative_y != 0 ||
-            current_dpad_as_mouse)
-        {
-            mouse_x = current_state.mouse_relative_x;
-            mouse_y = current_state.mouse_relative_y;
+        if (session_ended)
+        {   // the daemons game has quit, wait for the next one.
+            session_ended = false;
+            session_switch(1, session_idle_argv);
+        }
 
-            if (current_dpad_as_mouse > 0)
-            {
-                vector2d_clear(&mouse_move);
+        if (session_changed)
+        {   // new configs, start the mouse again with their settings.
+            session_changed = false;
 
-                mouse_move.x -= (is_pressed(GBTN_DPAD_LEFT ) ? 1.0f : 0.0f);
-                mouse_move.x += (is_pressed(GBTN_DPAD_RIGHT) ? 1.0f : 0.0f);
-                mouse_move.y -= (is_pressed(GBTN_DPAD_UP   ) ? 1.0f : 0.0f);
-                mouse_move.y += (is_pressed(GBTN_DPAD_DOWN ) ? 1.0f : 0.0f);
+            mouse_moving = false;
+            mouse_timer_set(0);
+            mouse_remainder_x = 0.0f;
+            mouse_remainder_y = 0.0f;
 
-                if (current_state.dpad_mouse_normalize)
-                    vector2d_normalize(&mouse_move);
+            mouse_tick = (current_state.mouse_tick > 0) ? current_state.mouse_tick : current_state.mouse_delay;
+            slow_scale = (100.0 / (float)(current_state.mouse_slow_scale));
+        }
 
-                mouse_x += (int)(mouse_move.x * current_state.dpad_mouse_step);
-                mouse_y += (int)(mouse_move.y * current_state.dpad_mouse_step);
-            }
+        Uint32 current_ticks = SDL_GetTicks();
+
+        if (reload_ready(current_ticks))
+        {
+            session_reload();
+            continue;
+        }
+
+        output_queue_run(current_ticks);
 
-            if (current_state.mouse_slow)
+        if (!mouse_moving)
+        {   // first step happens straight away, the rest come from the timer.
+            mouse_moving = mouse_motion_update(slow_scale, 1.0f);
+
+            if (mouse_moving)
             {
-                mouse_x = (int)((float)(mouse_x) / slow_scale);
-                mouse_y = (int)((float)(mouse_y) / slow_scale);
+                last_mouse_tick = monotonic_ms();
+                mouse_timer_set(mouse_tick);
             }
+        }
+        else if (mouse_timer_check())
+        {
+            double now = monotonic_ms();
+            double elapsed = now - last_mouse_tick;
 
-            emitRelativeMouseMotion(mouse_x, mouse_y);
+            // don't throw the cursor across the screen if we were stalled.
+            if (elapsed > (double)(mouse_tick * MOUSE_MAX_TICKS))
+                elapsed = (double)(mouse_tick * MOUSE_MAX_TICKS);
 
-            if (mouse_x != 0 || mouse_y != 0) {
-                mouse_moved=true;
-                GPTK2_DEBUG("relative mouse move %d %d\n", mouse_x, mouse_y);
-            }
+            last_mouse_tick = now;
+            mouse_moving = mouse_motion_update(slow_scale, (float)(elapsed / (double)current_state.mouse_delay));
+
+            if (!mouse_moving)
+                mouse_timer_set(0);
         }
 
-        if (current_state.mouse_absolute_x != 0 || current_state.mouse_absolute_y != 0)
+        // Sleep until the next thing we have to do, or until an input event arrives.
+        Sint32 timeout = -1;
+
+        // in evdev mode the timer is part of the epoll set.
+        if (mouse_moving && !evdev_mode)
+            timeout = mouse_timer_timeout();
+
+        Uint32 next_repeat;
+        if (state_next_repeat(&next_repeat))
         {
-            if (current_state.absolute_rotate == 90) {
-                mouse_x = current_state.absolute_center_x + (current_state.absolute_step * -current_state.mouse_absolute_y / INT16_MAX);
-                mouse_y = current_state.absolute_center_y + (current_state.absolute_step * current_state.mouse_absolute_x / INT16_MAX);
-            }
-            else if (current_state.absolute_rotate == 180) { 
-                mouse_x = current_state.absolute_center_x + (current_state.absolute_step * -current_state.mouse_absolute_x / INT16_MAX);
-                mouse_y = current_state.absolute_center_y + (current_state.absolute_step * -current_state.mouse_absolute_y / INT16_MAX);
-            }
-            else if (current_state.absolute_rotate == 270) {
-                mouse_x = current_state.absolute_center_x + (current_state.absolute_step * current_state.mouse_absolute_y / INT16_MAX);
-                mouse_y = current_state.absolute_center_y + (current_state.absolute_step * -current_state.mouse_absolute_x / INT16_MAX);
-            }
-            else {
-                mouse_x = current_state.absolute_center_x + (current_state.absolute_step * current_state.mouse_absolute_x / INT16_MAX);
-                mouse_y = current_state.absolute_center_y + (current_state.absolute_step * current_state.mouse_absolute_y / INT16_MAX);
-            }
-            
-            if (abs(mouse_x - current_state.absolute_center_x) > current_state.absolute_deadzone ||
-                abs(mouse_y - current_state.absolute_center_y) > current_state.absolute_deadzone) {
-                
-                emitAbsoluteMouseMotion(mouse_x, mouse_y);
-                mouse_moved=true;
-            }
+            Sint32 repeat_timeout = ticks_until(current_ticks, next_repeat);
+
+            if (timeout < 0 || repeat_timeout < timeout)
+                timeout = repeat_timeout;
         }
 
-        if (mouse_moved) {
-            // sleep.
-            // TODO: FIX ME
-            SDL_Delay(current_state.mouse_delay);
+        Uint32 next_output;
+        if (output_queue_next(&next_output))
+        {
+            Sint32 output_timeout = ticks_until(current_ticks, next_output);
+
+            if (timeout < 0 || output_timeout < timeout)
+                timeout = output_timeout;
         }
-        else {
+
+        Uint32 next_reload;
+        if (reload_next(&next_reload))
+        {
+            Sint32 reload_timeout = ticks_until(current_ticks, next_reload);
+
+            if (timeout < 0 || reload_timeout < timeout)
+                timeout = reload_timeout;
+        }
+
+        // everything from this pass goes out as one write per device.
+        emit_flush();
+
+        if (!current_state.running)
+            break;
+
+        if (evdev_mode)
+        {
+            loop_wait(timeout);
+        }
+        else if (timeout < 0)
+        {
             // GPTK2_DEBUG("-- WAIT FOR EVENT --\n");
             if (!SDL_WaitEvent(&event))
             {
@@ -514,8 +1282,30 @@ int main(int argc, char* argv[])
 
             handleInputEvent(&event);
         }
+        else if (SDL_WaitEventTimeout(&event, timeout))
+        {
+            handleInputEvent(&event);
+        }
+    }
+
+    process_quit();
+    status_quit();
+    control_quit();
+    reload_quit();
+    daemon_quit();
+
+    if (evdev_mode)
+    {
+        loop_remove_fd(mouse_timer_fd);
+        evdev_quit();
+        loop_quit();
     }
 
+    close(mouse_timer_fd);
+
+    // finish typing anything that is still queued.
+    output_queue_drain();
+
     SDL_Quit();
 
     /*
@@ -526,22 +1316,26 @@ int main(int argc, char* argv[])
 
     /* Clean up */
     if (kb_uinp_fd) {
+        emit_forget(kb_uinp_fd);
         ioctl(kb_uinp_fd, UI_DEV_DESTROY);
         close(kb_uinp_fd);
     }
     if (xbox_uinp_fd) {
+        emit_forget(xbox_uinp_fd);
         ioctl(xbox_uinp_fd, UI_DEV_DESTROY);
         close(xbox_uinp_fd);
     }
     if (abs_uinp_fd) {
+        emit_forget(abs_uinp_fd);
         ioctl(abs_uinp_fd, UI_DEV_DESTROY);
         close(abs_uinp_fd);
     }
 
-    config_quit();
-    state_quit();
-    input_quit();
-    string_quit();
+    child_quit();
+
+    output_queue_quit();
+    session_free();
+    session_forget_args();
 
-    return 0;
+    return child_exit_status();
 }
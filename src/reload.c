@@ -0,0 +1,252 @@
+/* Copyright (c) 2021-2024
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 2 of the License, or (at your option) any later version.
+#
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+#
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA 02110-1301 USA
+#
+* Authored by: Kris Henriksen <krishenriksen.work@gmail.com>
+#
+* AnberPorts-Keyboard-Mouse
+*
+* Part of the code is from from https://github.com/krishenriksen/AnberPorts/blob/master/AnberPorts-Keyboard-Mouse/main.c (mostly the fake keyboard)
+* Fake Xbox code from: https://github.com/Emanem/js2xbox
+*
+* Modified (badly) by: Shanti Gilbert for EmuELEC
+* Modified further by: Nikolai Wuttke for EmuELEC (Added support for SDL and the SDLGameControllerdb.txt)
+* Modified further by: Jacob Smith
+*
+* Any help improving this code would be greatly appreciated!
+*
+* DONE: Xbox360 mode: Fix triggers so that they report from 0 to 255 like real Xbox triggers
+*       Xbox360 mode: Figure out why the axis are not correctly labeled?  SDL_CONTROLLER_AXIS_RIGHTX / SDL_CONTROLLER_AXIS_RIGHTY / SDL_CONTROLLER_AXIS_TRIGGERLEFT / SDL_CONTROLLER_AXIS_TRIGGERRIGHT
+*       Keyboard mode: Add a config file option to load mappings from.
+*       add L2/R2 triggers
+*
+*/
+
+#include "gptokeyb2.h"
+#include "ini.h"
+
+#include <sys/inotify.h>
+
+#define RELOAD_MAX_FILES 16
+
+// editors often write a file in several steps, wait for them to settle.
+#define RELOAD_DELAY 100
+
+/* With --watch the configs a session loaded are watched with inotify, the
+ * directories are watched rather than the files so editors that save by
+ * renaming over the old file are seen too. A change just sets a deadline,
+ * the main loop reloads everything between events once it has passed.
+ */
+
+typedef struct
+{
+    char path[PATH_MAX];
+    const char *name;       // points into path.
+    int watch;
+    bool optional;
+} reload_file;
+
+static reload_file reload_files[RELOAD_MAX_FILES];
+static int reload_file_count = 0;
+
+static int reload_inotify_fd = -1;
+static bool reload_pending = false;
+static Uint32 reload_due = 0;
+
+
+static void reload_file_watch(reload_file *file)
+{
+    char directory[PATH_MAX];
+
+    strncpy(directory, file->path, PATH_MAX - 1);
+    directory[PATH_MAX - 1] = '\0';
+
+    char *slash = strrchr(directory, '/');
+
+    if (slash == directory)
+        slash[1] = '\0';
+    else if (slash != NULL)
+        slash[0] = '\0';
+    else
+        strcpy(directory, ".");
+
+    file->watch = inotify_add_watch(reload_inotify_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+
+    // a missing optional file just can't be watched.
+    if (file->watch < 0 && !file->optional)
+        fprintf(stderr, "Unable to watch '%s': %s\n", directory, strerror(errno));
+}
+
+
+void reload_add(const char *file_name, bool optional)
+{   // remember a config this session loaded.
+    if (reload_file_count >= RELOAD_MAX_FILES)
+        return;
+
+    reload_file *file = &reload_files[reload_file_count++];
+
+    // the daemon changes directory for each client.
+    if (realpath(file_name, file->path) == NULL)
+        strncpy(file->path, file_name, PATH_MAX - 1);
+
+    const char *slash = strrchr(file->path, '/');
+
+    file->name = (slash != NULL) ? slash + 1 : file->path;
+    file->optional = optional;
+    file->watch = -1;
+
+    if (reload_inotify_fd >= 0)
+        reload_file_watch(file);
+}
+
+
+void reload_clear()
+{   // a new session is starting, it will add its own files.
+    for (int i=0; i < reload_file_count; i++)
+    {
+        // directories can be shared, so this can fail.
+        if (reload_inotify_fd >= 0 && reload_files[i].watch >= 0)
+            inotify_rm_watch(reload_inotify_fd, reload_files[i].watch);
+    }
+
+    reload_file_count = 0;
+    reload_pending = false;
+}
+
+
+static void reload_callback(int fd, void *data)
+{
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    (void)data;
+
+    while (true)
+    {
+        ssize_t len = read(fd, buffer, sizeof(buffer));
+
+        if (len <= 0)
+            break;
+
+        for (char *ptr = buffer; ptr < buffer + len; )
+        {
+            const struct inotify_event *event = (const struct inotify_event *)ptr;
+
+            for (int i=0; event->len > 0 && i < reload_file_count; i++)
+            {
+                if (reload_files[i].watch == event->wd && strcmp(reload_files[i].name, event->name) == 0)
+                {
+                    reload_pending = true;
+                    reload_due = SDL_GetTicks() + RELOAD_DELAY;
+                }
+            }
+
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+
+static int reload_check_handler(void* user, const char* section, const char* name, const char* value)
+{
+    (void)user;
+    (void)section;
+    (void)name;
+    (void)value;
+
+    return 1;
+}
+
+
+bool reload_check()
+{   // make sure every file parses before the running configs are thrown away.
+    for (int i=0; i < reload_file_count; i++)
+    {
+        const reload_file *file = &reload_files[i];
+
+        if (file->optional && access(file->path, F_OK) != 0)
+            continue;
+
+        int result = ini_parse(file->path, reload_check_handler, NULL);
+
+        if (result < 0)
+        {
+            fprintf(stderr, "Unable to read '%s', keeping the current config.\n", file->path);
+            return false;
+        }
+
+        if (result > 0)
+        {
+            fprintf(stderr, "'%s' has an error on line %d, keeping the current config.\n", file->path, result);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool reload_next(Uint32 *next_ticks)
+{   // when the next reload is due, false if there isn't one.
+    if (!reload_pending)
+        return false;
+
+    *next_ticks = reload_due;
+    return true;
+}
+
+
+bool reload_ready(Uint32 current_ticks)
+{   // true once, when the files have settled.
+    if (!reload_pending || !SDL_TICKS_PASSED(current_ticks, reload_due))
+        return false;
+
+    reload_pending = false;
+    return true;
+}
+
+
+bool reload_init()
+{
+    reload_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (reload_inotify_fd < 0)
+    {
+        fprintf(stderr, "Unable to create the config watch: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (!loop_watch_fd(reload_inotify_fd, reload_callback, NULL))
+    {
+        close(reload_inotify_fd);
+        reload_inotify_fd = -1;
+        return false;
+    }
+
+    for (int i=0; i < reload_file_count; i++)
+        reload_file_watch(&reload_files[i]);
+
+    return true;
+}
+
+
+void reload_quit()
+{
+    if (reload_inotify_fd < 0)
+        return;
+
+    loop_unwatch_fd(reload_inotify_fd);
+    close(reload_inotify_fd);
+    reload_inotify_fd = -1;
+}
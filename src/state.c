@@ -56,6 +56,21 @@ typedef struct _controller_fd
 
 controller_fd *controller_fds = NULL;
 
+// buttons that are repeating, a min-heap on next_repeat.
+static Uint8 repeat_heap[GBTN_MAX];
+static int repeat_heap_pos[GBTN_MAX];
+static int repeat_heap_count = 0;
+
+// what each button resolves to through the temp layers and the stack, rebuilt on every state change.
+static const gptokeyb_button *resolved_button[GBTN_MAX];
+
+// resolved summary of config_stack[0..depth], entries above stack_summary_depth are stale.
+static layer_summary stack_summary[CFG_STACK_MAX];
+static int stack_summary_depth = -1;
+
+// the quit combo only tries once per press.
+static bool quit_combo_latched = false;
+
 
 void state_init()
 {
@@ -94,6 +109,15 @@ void state_init()
     controller_fds = NULL;
 
     exclusive_mode = false;
+
+    repeat_heap_count = 0;
+    for (int btn=0; btn < GBTN_MAX; btn++)
+        repeat_heap_pos[btn] = -1;
+
+    // the daemon starts again with new configs, nothing folded so far is any good.
+    stack_summary_depth = -1;
+
+    quit_combo_latched = false;
 }
 
 void state_quit()
@@ -120,6 +144,31 @@ void state_quit()
 }
 
 
+void state_release()
+{   // let go of everything still held, before the configs it came from are thrown away.
+    for (int btn=0; btn < GBTN_MAX; btn++)
+    {
+        if (!is_pressed(btn))
+            continue;
+
+        current_state.last_pressed |= (1<<btn);
+        update_button(btn, false);
+    }
+
+    controllers_disable_exclusive();
+}
+
+
+void state_reset()
+{   // a clean state for the next daemon session, the controllers stay open.
+    controller_fd *fds = controller_fds;
+
+    state_init();
+
+    controller_fds = fds;
+}
+
+
 void controller_add_fd(Sint32 which, int fd)
 {
     controller_fd *new_fd = (controller_fd*)gptk_malloc(sizeof(controller_fd));
@@ -213,10 +262,48 @@ void controllers_disable_exclusive()
 }
 
 
+static void state_summary_invalidate(int depth)
+{   // stack_summary[depth] and above need to be recalculated.
+    if (stack_summary_depth >= depth)
+        stack_summary_depth = depth - 1;
+}
+
+
+static void temp_stack_unlink(int btn)
+{
+    int prev = config_temp_stack_prev[btn];
+    int next = config_temp_stack_next[btn];
+
+    if (prev != -1)
+        config_temp_stack_next[prev] = next;
+    else
+        config_temp_stack_bottom = next;
+
+    if (next != -1)
+        config_temp_stack_prev[next] = prev;
+    else
+        config_temp_stack_top = prev;
+
+    config_temp_stack_prev[btn] = -1;
+    config_temp_stack_next[btn] = -1;
+}
+
+
 void push_temp_state(gptokeyb_config *new_config, int btn)
 {
+    if (config_temp_stack[btn] != NULL)
+        temp_stack_unlink(btn);
+
     config_temp_stack[btn] = new_config;
-    config_temp_stack_order[btn] = ++config_temp_stack_order_id;
+    config_temp_stack_prev[btn] = config_temp_stack_top;
+    config_temp_stack_next[btn] = -1;
+
+    if (config_temp_stack_top != -1)
+        config_temp_stack_next[config_temp_stack_top] = btn;
+    else
+        config_temp_stack_bottom = btn;
+
+    config_temp_stack_top = btn;
 
     state_change_update();
 }
@@ -224,21 +311,10 @@ void push_temp_state(gptokeyb_config *new_config, int btn)
 
 void pop_temp_state(int btn)
 {
-    bool all_done = true;
-    config_temp_stack[btn] = NULL;
-    config_temp_stack_order[btn] = 0;
-
-    for (int sbtn=0; sbtn < GBTN_MAX; sbtn++)
-    {
-        if (config_temp_stack[sbtn] != NULL)
-        {
-            all_done = false;
-            break;
-        }
-    }
+    if (config_temp_stack[btn] != NULL)
+        temp_stack_unlink(btn);
 
-    if (all_done)
-        config_temp_stack_order_id = 0;
+    config_temp_stack[btn] = NULL;
 
     state_change_update();
 }
@@ -265,6 +341,7 @@ void push_state(gptokeyb_config *new_config)
 #endif
 
     config_stack[++gptokeyb_config_depth] = new_config;
+    state_summary_invalidate(gptokeyb_config_depth);
 
     state_change_update();
 }
@@ -279,6 +356,7 @@ void set_state(gptokeyb_config *new_config)
 #endif
 
     config_stack[gptokeyb_config_depth] = new_config;
+    state_summary_invalidate(gptokeyb_config_depth);
 
     state_change_update();
 }
@@ -334,41 +412,153 @@ Uint32 held_for(int btn)
 }
 
 
+static bool repeat_before(int a, int b)
+{
+    Uint32 a_ticks = current_state.next_repeat[repeat_heap[a]];
+    Uint32 b_ticks = current_state.next_repeat[repeat_heap[b]];
+
+    if (a_ticks != b_ticks)
+        return (Sint32)(a_ticks - b_ticks) < 0;
+
+    // same order the buttons used to be checked in.
+    return repeat_heap[a] < repeat_heap[b];
+}
+
+
+static void repeat_swap(int a, int b)
+{
+    Uint8 temp = repeat_heap[a];
+
+    repeat_heap[a] = repeat_heap[b];
+    repeat_heap[b] = temp;
+
+    repeat_heap_pos[repeat_heap[a]] = a;
+    repeat_heap_pos[repeat_heap[b]] = b;
+}
+
+
+static void repeat_sift(int index)
+{
+    while (index > 0 && repeat_before(index, (index - 1) / 2))
+    {
+        repeat_swap(index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+
+    while (true)
+    {
+        int smallest = index;
+        int left = index * 2 + 1;
+        int right = left + 1;
+
+        if (left < repeat_heap_count && repeat_before(left, smallest))
+            smallest = left;
+
+        if (right < repeat_heap_count && repeat_before(right, smallest))
+            smallest = right;
+
+        if (smallest == index)
+            break;
+
+        repeat_swap(index, smallest);
+        index = smallest;
+    }
+}
+
+
+static void repeat_schedule(int btn, Uint32 next_ticks)
+{   // start repeating btn, or move its next repeat.
+    current_state.in_repeat |= (1<<btn);
+    current_state.next_repeat[btn] = next_ticks;
+
+    if (repeat_heap_pos[btn] < 0)
+    {
+        repeat_heap[repeat_heap_count] = btn;
+        repeat_heap_pos[btn] = repeat_heap_count++;
+    }
+
+    repeat_sift(repeat_heap_pos[btn]);
+}
+
+
+static void repeat_cancel(int btn)
+{
+    int index = repeat_heap_pos[btn];
+
+    current_state.in_repeat &= ~(1<<btn);
+
+    if (index < 0)
+        return;
+
+    repeat_heap_pos[btn] = -1;
+    repeat_heap_count--;
+
+    if (index == repeat_heap_count)
+        return;
+
+    repeat_heap[index] = repeat_heap[repeat_heap_count];
+    repeat_heap_pos[repeat_heap[index]] = index;
+    repeat_sift(index);
+}
+
+
+void state_process_killed()
+{   // the quit combo got rid of the program, maybe some time after process_kill() was called.
+    // the daemon stays around for the next game.
+    if (daemon_mode)
+        session_ended = true;
+    else
+        current_state.running = false;
+}
+
+
 void state_update()
 {   /* This updates the internal state machine.
      *
      * This handles things like START + SELECT to quit, button repeating.
      */
-    Uint32 current_ticks = SDL_GetTicks();
-
     if (is_pressed(GBTN_START) && is_pressed(current_state.hotkey_gbtn))
     {
-        if (process_kill())
-            current_state.running = false;
+        if (!quit_combo_latched)
+        {
+            quit_combo_latched = true;
+
+            if (process_kill())
+                state_process_killed();
+        }
+    }
+    else
+    {
+        quit_combo_latched = false;
     }
 
     current_state.last_pressed = current_state.pressed;
 
-    for (int btn=0; btn < GBTN_MAX; btn++)
+    if (repeat_heap_count > 0)
     {
-        if ((current_state.in_repeat & (1<<btn)) == 0)
-            continue;
+        Uint32 current_ticks = SDL_GetTicks();
 
-        if (!is_pressed(btn))
-            continue;
+        while (repeat_heap_count > 0)
+        {
+            int btn = repeat_heap[0];
 
-        if (!SDL_TICKS_PASSED(current_ticks, current_state.next_repeat[btn]))
-            continue;
+            if (!SDL_TICKS_PASSED(current_ticks, current_state.next_repeat[btn]))
+                break;
 
-        // release button
-        update_button(btn, false);
+            if (!is_pressed(btn))
+            {
+                repeat_cancel(btn);
+                continue;
+            }
 
-        // press button
-        current_state.in_repeat    |=  (1<<btn);
-        current_state.last_pressed &= ~(1<<btn);
-        update_button(btn, true);
+            // release button
+            update_button(btn, false);
 
-        current_state.next_repeat[btn] = (current_ticks + current_state.repeat_rate);
+            // press button
+            repeat_schedule(btn, current_ticks + current_state.repeat_rate);
+            current_state.last_pressed &= ~(1<<btn);
+            update_button(btn, true);
+        }
     }
 
     // We don't need to rest absolute values only relative movement
@@ -380,241 +570,153 @@ void state_update()
 }
 
 
-void state_change_update()
-{   // check as mouse_move and input set stuff.
-
-    #define NOT_FOUND_DPADS (!found_dpad_as_mouse || !found_left_analog_as_mouse || !found_right_analog_as_mouse || !found_left_analog_as_absolute_mouse || !found_right_analog_as_mouse)
+bool state_next_repeat(Uint32 *next_ticks)
+{   // finds when the next button repeat is due, returns false if nothing is repeating.
+    if (repeat_heap_count == 0)
+        return false;
 
-    #define NOT_FOUND_INPUT_SETS ((found_charset == NULL) && (found_wordset == NULL))
+    *next_ticks = current_state.next_repeat[repeat_heap[0]];
+    return true;
+}
 
-    bool found_dpad_as_mouse = false;
-    bool found_left_analog_as_mouse = false;
-    bool found_right_analog_as_mouse = false;
-    bool found_left_analog_as_absolute_mouse = false;
-    bool found_right_analog_as_absolute_mouse = false;
-    bool found_mouse_wheel_amount = false;
 
-    int change_exclusive_mode = EXL_PARENT;
+static void state_resolve_buttons()
+{   // flatten the temp layers and the stack into resolved_button.
+    int unresolved = GBTN_MAX;
 
-    const char *found_charset = NULL;
-    const char *found_wordset = NULL;
+    for (int btn=0; btn < GBTN_MAX; btn++)
+        resolved_button[btn] = NULL;
 
-    // check temp stacks
-    int order_id = config_temp_stack_order_id;
-    while (order_id > 0)
+    // check temp states, newest first
+    for (int sbtn=config_temp_stack_top; sbtn != -1 && unresolved > 0; sbtn = config_temp_stack_prev[sbtn])
     {
-        for (int sbtn=0; sbtn < GBTN_MAX; sbtn++)
+        gptokeyb_config *current = config_temp_stack[sbtn];
+
+        for (int btn=0; btn < GBTN_MAX; btn++)
         {
-            if (config_temp_stack[sbtn] == NULL)
+            if (resolved_button[btn] != NULL || current->button[btn].action == ACT_PARENT)
                 continue;
 
-            if (config_temp_stack_order[sbtn] != order_id)
-                continue;
+            resolved_button[btn] = &current->button[btn];
+            unresolved--;
+        }
+    }
 
-            gptokeyb_config *current = config_temp_stack[sbtn];
+    // check stack
+    int current_depth = gptokeyb_config_depth;
 
-            if (change_exclusive_mode == EXL_PARENT && current->exclusive_mode != EXL_PARENT)
-            {
-                change_exclusive_mode = current->exclusive_mode;
-            }
+    while (current_depth >= 0 && unresolved > 0)
+    {
+        gptokeyb_config *current = config_stack[current_depth];
 
-            if (!found_mouse_wheel_amount && current->mouse_wheel_amount > 0)
-            {
-                found_mouse_wheel_amount = true;
-                current_mouse_wheel_amount = current->mouse_wheel_amount;
-            }
+        for (int btn=0; btn < GBTN_MAX; btn++)
+        {
+            if (resolved_button[btn] != NULL || current->button[btn].action == ACT_PARENT)
+                continue;
 
-            if (NOT_FOUND_INPUT_SETS)
-            {
-                found_charset = current->charset;
-                found_wordset = current->wordset;
-            }
+            resolved_button[btn] = &current->button[btn];
+            unresolved--;
+        }
 
-            if (NOT_FOUND_DPADS)
-            {
-                // relative positioning
-                if (!found_dpad_as_mouse && current->dpad_as_mouse != MOUSE_MOVEMENT_PARENT)
-                {
-                    current_dpad_as_mouse = (current->dpad_as_mouse == MOUSE_MOVEMENT_ON);
-                    found_dpad_as_mouse = true;
-                }
+        current_depth--;
+    }
+}
 
-                if (!found_left_analog_as_mouse && current->left_analog_as_mouse != MOUSE_MOVEMENT_PARENT)
-                {
-                    current_left_analog_as_mouse = (current->left_analog_as_mouse == MOUSE_MOVEMENT_ON);
-                    found_left_analog_as_mouse = true;
-                }
 
-                if (!found_right_analog_as_mouse && current->right_analog_as_mouse != MOUSE_MOVEMENT_PARENT)
-                {
-                    current_right_analog_as_mouse = (current->right_analog_as_mouse == MOUSE_MOVEMENT_ON);
-                    found_right_analog_as_mouse = true;
-                }
+static void summary_fold(layer_summary *result, const layer_summary *top, const layer_summary *below)
+{   // combine top over below, result can be the same as either.
+    layer_summary folded;
 
-                if (!found_left_analog_as_absolute_mouse && current->left_analog_as_absolute_mouse != MOUSE_MOVEMENT_PARENT)
-                {
-                    current_left_analog_as_absolute_mouse = (current->left_analog_as_absolute_mouse == MOUSE_MOVEMENT_ON);
-                    found_left_analog_as_absolute_mouse = true;
-                }
+    folded.decided = top->decided | below->decided;
+    folded.enabled = (top->enabled & top->decided) | (below->enabled & below->decided & ~top->decided);
 
-                if (!found_right_analog_as_absolute_mouse && current->right_analog_as_absolute_mouse != MOUSE_MOVEMENT_PARENT)
-                {
-                    current_right_analog_as_absolute_mouse = (current->right_analog_as_absolute_mouse == MOUSE_MOVEMENT_ON);
-                    found_right_analog_as_absolute_mouse = true;
-                }
-            }
-        }
+    folded.exclusive_mode = (top->exclusive_mode != EXL_PARENT) ? top->exclusive_mode : below->exclusive_mode;
+    folded.mouse_wheel_amount = (top->mouse_wheel_amount > 0) ? top->mouse_wheel_amount : below->mouse_wheel_amount;
 
-        order_id--;
+    if (top->charset != NULL || top->wordset != NULL)
+    {
+        folded.charset = top->charset;
+        folded.wordset = top->wordset;
     }
-
-    int current_depth = gptokeyb_config_depth;
-
-    while (current_depth >= 0)
+    else
     {
-        gptokeyb_config *current = config_stack[current_depth];
-
-        if (change_exclusive_mode == EXL_PARENT && current->exclusive_mode != EXL_PARENT)
-        {
-            change_exclusive_mode = current->exclusive_mode;
-        }
-
-        if (!found_mouse_wheel_amount && current->mouse_wheel_amount > 0)
-        {
-            found_mouse_wheel_amount = true;
-            current_mouse_wheel_amount = current->mouse_wheel_amount;
-        }
+        folded.charset = below->charset;
+        folded.wordset = below->wordset;
+    }
 
-        if (NOT_FOUND_INPUT_SETS)
-        {
-            found_charset = current->charset;
-            found_wordset = current->wordset;
-        }
+    *result = folded;
+}
 
-        if (NOT_FOUND_DPADS)
-        {
-            // relative positioning
-            if (!found_dpad_as_mouse && current->dpad_as_mouse != MOUSE_MOVEMENT_PARENT)
-            {
-                current_dpad_as_mouse = (current->dpad_as_mouse == MOUSE_MOVEMENT_ON);
-                found_dpad_as_mouse = true;
-            }
 
-            if (!found_left_analog_as_mouse && current->left_analog_as_mouse != MOUSE_MOVEMENT_PARENT)
-            {
-                current_left_analog_as_mouse = (current->left_analog_as_mouse == MOUSE_MOVEMENT_ON);
-                found_left_analog_as_mouse = true;
-            }
+void state_change_update()
+{   // check as mouse_move and input set stuff.
+    layer_summary resolved;
 
-            if (!found_right_analog_as_mouse && current->right_analog_as_mouse != MOUSE_MOVEMENT_PARENT)
-            {
-                current_right_analog_as_mouse = (current->right_analog_as_mouse == MOUSE_MOVEMENT_ON);
-                found_right_analog_as_mouse = true;
-            }
+    state_resolve_buttons();
 
-            if (!found_left_analog_as_absolute_mouse && current->left_analog_as_absolute_mouse != MOUSE_MOVEMENT_PARENT)
-            {
-                current_left_analog_as_absolute_mouse = (current->left_analog_as_absolute_mouse == MOUSE_MOVEMENT_ON);
-                found_left_analog_as_absolute_mouse = true;
-            }
+    // only the part of the stack that changed needs folding.
+    for (int depth=stack_summary_depth + 1; depth <= gptokeyb_config_depth; depth++)
+    {
+        if (depth == 0)
+            stack_summary[depth] = config_stack[depth]->summary;
+        else
+            summary_fold(&stack_summary[depth], &config_stack[depth]->summary, &stack_summary[depth - 1]);
+    }
 
-            if (!found_right_analog_as_absolute_mouse && current->right_analog_as_absolute_mouse != MOUSE_MOVEMENT_PARENT)
-            {
-                current_right_analog_as_absolute_mouse = (current->right_analog_as_absolute_mouse == MOUSE_MOVEMENT_ON);
-                found_right_analog_as_absolute_mouse = true;
-            }
-        }
+    stack_summary_depth = gptokeyb_config_depth;
+    resolved = stack_summary[gptokeyb_config_depth];
 
-        current_depth--;
+    // temp states go on top, oldest first.
+    for (int sbtn=config_temp_stack_bottom; sbtn != -1; sbtn = config_temp_stack_next[sbtn])
+    {
+        summary_fold(&resolved, &config_temp_stack[sbtn]->summary, &resolved);
     }
 
-    if (found_charset)
+    if (resolved.charset)
     {
-        input_load_char_set(found_charset);
+        input_load_char_set(resolved.charset);
     }
-    else if (found_wordset)
+    else if (resolved.wordset)
     {
-        input_load_word_set(found_wordset);
+        input_load_word_set(resolved.wordset);
     }
     else
     {
         input_stop();
     }
 
-    if (change_exclusive_mode == EXL_TRUE)
+    if (resolved.exclusive_mode == EXL_TRUE)
         controllers_enable_exclusive();
 
-    else if (change_exclusive_mode == EXL_FALSE)
+    else if (resolved.exclusive_mode == EXL_FALSE)
         controllers_disable_exclusive();
 
-    if (!found_mouse_wheel_amount)
+    if (resolved.mouse_wheel_amount > 0)
+        current_mouse_wheel_amount = resolved.mouse_wheel_amount;
+    else
         current_mouse_wheel_amount = DEFAULT_MOUSE_WHEEL_AMOUNT;
 
-    if (!found_dpad_as_mouse)
-        current_dpad_as_mouse = false;
+    current_dpad_as_mouse                  = (resolved.enabled & LSF_DPAD_AS_MOUSE) != 0;
+    current_left_analog_as_mouse           = (resolved.enabled & LSF_LEFT_ANALOG_AS_MOUSE) != 0;
+    current_right_analog_as_mouse          = (resolved.enabled & LSF_RIGHT_ANALOG_AS_MOUSE) != 0;
+    current_left_analog_as_absolute_mouse  = (resolved.enabled & LSF_LEFT_ANALOG_AS_ABSOLUTE_MOUSE) != 0;
+    current_right_analog_as_absolute_mouse = (resolved.enabled & LSF_RIGHT_ANALOG_AS_ABSOLUTE_MOUSE) != 0;
 
-    if (!found_left_analog_as_mouse)
-        current_left_analog_as_mouse = false;
+    status_update();
+}
 
-    if (!found_right_analog_as_mouse)
-        current_right_analog_as_mouse = false;
 
-    if (!found_left_analog_as_absolute_mouse)
-        current_left_analog_as_absolute_mouse = false;
+void state_config_changed()
+{   // the configs themselves changed, recalculate everything.
+    stack_summary_depth = -1;
 
-    if (!found_right_analog_as_absolute_mouse)
-        current_right_analog_as_absolute_mouse = false;
+    state_change_update();
 }
 
 
 const gptokeyb_button *state_button(int btn)
 {   // resolve a button through parent states.
-    gptokeyb_button *button;
-
-    // check temp states
-    int order_id = config_temp_stack_order_id;
-    while (order_id > 0)
-    {
-        for (int sbtn=0; sbtn < GBTN_MAX; sbtn++)
-        {
-            if (config_temp_stack[sbtn] == NULL)
-                continue;
-
-            if (config_temp_stack_order[sbtn] != order_id)
-                continue;
-
-            gptokeyb_config *current = config_temp_stack[sbtn];
-
-            if (current->button[btn].action == ACT_PARENT)
-                continue;
-
-            GPTK2_DEBUG("found temp[%s] -> %s\n", gbtn_names[sbtn], gbtn_names[btn]);
-
-            return &current->button[btn];
-        }
-
-        order_id--;
-    }
-
-    // check stack
-    int current_depth = gptokeyb_config_depth;
-
-    while (current_depth >= 0)
-    {
-        gptokeyb_config *config = config_stack[current_depth];
-
-        button = &config->button[btn];
-
-        if (button->action != ACT_PARENT)
-        {
-            GPTK2_DEBUG("found stack[%d] -> %s\n", current_depth, gbtn_names[btn]);
-            return button;
-        }
-
-        current_depth--;
-    }
-
-    return NULL;
+    return resolved_button[btn];
 }
 
 
@@ -629,6 +731,8 @@ void update_button(int btn, bool pressed)
     else
         current_state.pressed &= ~btn_mask;
 
+    status_pressed();
+
     if (was_pressed(btn))
     {
         GPTK2_DEBUG("%s -> %s\n", gbtn_names[btn], (pressed ? "pressed" : "released"));
@@ -677,10 +781,7 @@ void update_button(int btn, bool pressed)
                 emitKey(kb_uinp_fd, button->keycode, true, button->modifier);
 
                 if (button->repeat && !(current_state.in_repeat & btn_mask))
-                {
-                    current_state.in_repeat |= btn_mask;
-                    current_state.next_repeat[btn] = (current_ticks + current_state.repeat_delay);
-                }
+                    repeat_schedule(btn, current_ticks + current_state.repeat_delay);
             }
         }
         else if (button->action == ACT_SPECIAL && button->special == SPC_MOUSE_SLOW)
@@ -750,6 +851,8 @@ void update_button(int btn, bool pressed)
             default:
                 break;
             }
+
+            status_update();
         }
         else if (GBTN_IS_DPAD(btn) && current_dpad_as_mouse)
         {   // this way we can always clear the mouse_move flag if the state changes.
@@ -757,8 +860,7 @@ void update_button(int btn, bool pressed)
         }
         else if (button->repeat && !(current_state.in_repeat & btn_mask))
         {
-            current_state.in_repeat |= btn_mask;
-            current_state.next_repeat[btn] = (current_ticks + current_state.repeat_delay);
+            repeat_schedule(btn, current_ticks + current_state.repeat_delay);
         }
 
         if (button->keycode != 0)
@@ -789,7 +891,7 @@ void update_button(int btn, bool pressed)
         // Always clear the state of a mouse button if it is released.
         current_state.mouse_slow &= ~btn_mask;
         current_state.mouse_move &= ~btn_mask;
-        current_state.in_repeat  &= ~btn_mask;
+        repeat_cancel(btn);
 
         if (button->keycode != 0)
         {
@@ -0,0 +1,218 @@
+/* Copyright (c) 2021-2024
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 2 of the License, or (at your option) any later version.
+#
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+#
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA 02110-1301 USA
+#
+* Authored by: Kris Henriksen <krishenriksen.work@gmail.com>
+#
+* AnberPorts-Keyboard-Mouse
+*
+* Part of the code is from from https://github.com/krishenriksen/AnberPorts/blob/master/AnberPorts-Keyboard-Mouse/main.c (mostly the fake keyboard)
+* Fake Xbox code from: https://github.com/Emanem/js2xbox
+*
+* Modified (badly) by: Shanti Gilbert for EmuELEC
+* Modified further by: Nikolai Wuttke for EmuELEC (Added support for SDL and the SDLGameControllerdb.txt)
+* Modified further by: Jacob Smith
+*
+* Any help improving this code would be greatly appreciated!
+*
+* DONE: Xbox360 mode: Fix triggers so that they report from 0 to 255 like real Xbox triggers
+*       Xbox360 mode: Figure out why the axis are not correctly labeled?  SDL_CONTROLLER_AXIS_RIGHTX / SDL_CONTROLLER_AXIS_RIGHTY / SDL_CONTROLLER_AXIS_TRIGGERLEFT / SDL_CONTROLLER_AXIS_TRIGGERRIGHT
+*       Keyboard mode: Add a config file option to load mappings from.
+*       add L2/R2 triggers
+*
+*/
+
+#include "gptokeyb2.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define STATUS_MAGIC   0x53545047  // "GPTS"
+#define STATUS_VERSION 1
+
+#define STATUS_MAX_LAYERS 16
+#define STATUS_NAME_SIZE  64
+#define STATUS_TEXT_SIZE  128
+
+/* --status keeps a small page in /dev/shm/gptokeyb2-<uid>.status up to date
+ * for launchers and overlays, they can map it and read it whenever they like
+ * without talking to us. The layout only ever grows at the end, readers
+ * should check magic, version and size.
+ *
+ * It is a seqlock, sequence is odd while we are writing. Readers load
+ * sequence (acquire), skip if odd, copy what they want, then load sequence
+ * again and retry if it changed.
+ */
+
+typedef struct
+{
+    Uint32 magic;
+    Uint32 version;
+    Uint32 size;                // sizeof(status_page)
+    Uint32 sequence;
+
+    Uint32 pid;
+    Uint32 pressed;             // bitmask of GBTN_* buttons held down
+    Sint32 depth;               // layers[0 .. depth] are in use, bottom first
+    Sint32 text_active;         // 1 while a charset or wordset is active
+    Sint32 text_cursor;         // offset of the letter being picked in text
+
+    char layers[STATUS_MAX_LAYERS][STATUS_NAME_SIZE];
+    char text[STATUS_TEXT_SIZE];
+} status_page;
+
+static status_page *status = NULL;
+static char status_path[PATH_MAX];
+
+
+static void status_write_begin()
+{
+    __atomic_store_n(&status->sequence, status->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+static void status_write_end()
+{
+    __atomic_store_n(&status->sequence, status->sequence + 1, __ATOMIC_RELEASE);
+}
+
+
+void status_pressed()
+{   // cheap enough for every button press.
+    if (status == NULL)
+        return;
+
+    status_write_begin();
+    status->pressed = current_state.pressed;
+    status_write_end();
+}
+
+
+void status_update()
+{   // the layers or the text changed.
+    size_t cursor = 0;
+
+    if (status == NULL)
+        return;
+
+    const char *text = input_current_text(&cursor);
+
+    status_write_begin();
+
+    status->pressed = current_state.pressed;
+    status->depth = 0;
+
+    for (int i=0; i <= gptokeyb_config_depth && i < STATUS_MAX_LAYERS; i++)
+    {
+        strncpy(status->layers[i], config_stack[i]->name, STATUS_NAME_SIZE - 1);
+        status->layers[i][STATUS_NAME_SIZE - 1] = '\0';
+        status->depth = i;
+    }
+
+    status->text_active = input_active() ? 1 : 0;
+    status->text_cursor = (Sint32)cursor;
+
+    strncpy(status->text, text, STATUS_TEXT_SIZE - 1);
+    status->text[STATUS_TEXT_SIZE - 1] = '\0';
+
+    status_write_end();
+}
+
+
+bool status_init()
+{
+    if (snprintf(status_path, sizeof(status_path), "/dev/shm/gptokeyb2-%u.status", (unsigned)getuid()) >= (int)sizeof(status_path))
+        return false;
+
+    /* /dev/shm is world writable and the name is easy to guess, we often run
+     * as root, so never write through anything someone else left there. A
+     * new file every time, and it has to be ours.
+     */
+    struct stat info;
+
+    if (unlink(status_path) < 0 && errno != ENOENT)
+    {
+        fprintf(stderr, "Unable to remove the old '%s': %s\n", status_path, strerror(errno));
+        return false;
+    }
+
+    int fd = open(status_path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "Unable to create '%s': %s\n", status_path, strerror(errno));
+        return false;
+    }
+
+    if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode) || info.st_uid != geteuid())
+    {
+        fprintf(stderr, "'%s' is not a file we own.\n", status_path);
+        close(fd);
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(status_page)) < 0)
+    {
+        fprintf(stderr, "Unable to size '%s': %s\n", status_path, strerror(errno));
+        close(fd);
+        unlink(status_path);
+        return false;
+    }
+
+    void *page = mmap(NULL, sizeof(status_page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    // the mapping keeps it alive.
+    close(fd);
+
+    if (page == MAP_FAILED)
+    {
+        fprintf(stderr, "Unable to map '%s': %s\n", status_path, strerror(errno));
+        unlink(status_path);
+        return false;
+    }
+
+    status = (status_page *)page;
+
+    status->size    = sizeof(status_page);
+    status->version = STATUS_VERSION;
+    status->pid     = (Uint32)getpid();
+
+    status_update();
+
+    // last, so readers never see a half filled page as valid.
+    __atomic_store_n(&status->magic, STATUS_MAGIC, __ATOMIC_RELEASE);
+
+    printf("Status page at '%s'\n", status_path);
+
+    return true;
+}
+
+
+void status_quit()
+{
+    if (status == NULL)
+        return;
+
+    status_write_begin();
+    status->pid = 0;
+    status_write_end();
+
+    munmap(status, sizeof(status_page));
+    status = NULL;
+
+    unlink(status_path);
+}
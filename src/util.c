@@ -37,14 +37,102 @@
 
 #include "gptokeyb2.h"
 
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
 typedef struct _string_reg
 {
     struct _string_reg *next;
+    Uint32 hash;
     int counter;
     char *string;
 } string_reg;
 
-static string_reg *root_string = NULL;
+/* Everything built while loading configs (configs, charsets, wordsets and the
+ * interned strings) is bump allocated from an arena and released in one go.
+ */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// what malloc guarantees, data is padded out to it so every allocation keeps it.
+#define ARENA_ALIGN _Alignof(max_align_t)
+
+typedef struct _arena_block
+{
+    struct _arena_block *next;
+    size_t size;
+    size_t used;
+    _Alignas(max_align_t) char data[];
+} arena_block;
+
+struct _gptk_arena
+{
+    arena_block *blocks;
+    size_t allocated;
+};
+
+gptk_arena *load_arena = NULL;
+
+// interned strings, a chained hash table that doubles when it gets 3/4 full.
+#define STRING_TABLE_INITIAL 256
+
+static string_reg **string_table = NULL;
+static size_t string_table_size = 0;
+static size_t string_count = 0;
+
+static size_t string_lookups = 0;
+static size_t string_compares = 0;
+static size_t string_resizes = 0;
+
+/* Output is collected per device and written with one write() per flush.
+ *
+ * A frame is ended with a single SYN_REPORT when it is flushed, or early if
+ * the same event code shows up twice so nothing gets merged away.
+ */
+#define EMIT_MAX_DEVICES 4
+#define EMIT_BUFFER_SIZE 64
+
+typedef struct
+{
+    int fd;
+    int count;
+    int frame_start;
+    struct input_event events[EMIT_BUFFER_SIZE];
+} emit_buffer;
+
+static emit_buffer emit_buffers[EMIT_MAX_DEVICES];
+
+/* Key presses that have to happen later (text input, pc quit) go into a
+ * min-heap ordered by due time, the main loop runs them when they are due.
+ * A function can be queued the same way, to run once the keys before it
+ * have gone out.
+ */
+#define OUTPUT_QUEUE_INITIAL 64
+
+// how long text input keys are held, and the gap after releasing them.
+#define TEXT_INPUT_HOLD 16
+#define PC_QUIT_HOLD 15
+
+typedef struct
+{
+    Uint32 due;
+    Uint32 sequence;
+    int fd;
+    int code;
+    int modifier;
+    bool pressed;
+    void (*call)(void);     // run this instead of sending a key
+} output_event;
+
+static output_event *output_queue = NULL;
+static int output_queue_count = 0;
+static int output_queue_size = 0;
+static Uint32 output_queue_sequence = 0;
+static bool output_queue_draining = false;
+
+// when the last queued text input key is finished.
+static Uint32 text_input_tail = 0;
 
 
 void *gptk_malloc(size_t size)
@@ -80,27 +168,115 @@ void *gptk_realloc(void *old_data, size_t old_size, size_t size)
 }
 
 
+gptk_arena *arena_create()
+{
+    return (gptk_arena *)gptk_malloc(sizeof(gptk_arena));
+}
+
+
+void *arena_alloc(gptk_arena *arena, size_t size)
+{   // zeroed like gptk_malloc, but only freed with the whole arena.
+    arena_block *block = arena->blocks;
+
+    size = (size + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1);
+
+    if (block == NULL || (block->size - block->used) < size)
+    {
+        size_t block_size = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+
+        block = (arena_block *)gptk_malloc(sizeof(arena_block) + block_size);
+        block->size = block_size;
+
+        if (arena->blocks != NULL && size > ARENA_BLOCK_SIZE)
+        {   // keep filling the current block, big allocations go behind it.
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        }
+        else
+        {
+            block->next = arena->blocks;
+            arena->blocks = block;
+        }
+    }
+
+    void *data = block->data + block->used;
+
+    block->used += size;
+    arena->allocated += size;
+
+    return data;
+}
+
+
+void arena_destroy(gptk_arena *arena)
+{
+    if (arena == NULL)
+        return;
+
+    arena_block *block = arena->blocks;
+
+    while (block != NULL)
+    {
+        arena_block *next = block->next;
+
+        free(block);
+        block = next;
+    }
+
+    free(arena);
+}
+
+
+size_t arena_allocated(const gptk_arena *arena)
+{
+    return arena->allocated;
+}
+
+
 struct _token_ctx
 {
     char separator;
     char *next_token;
     char *curr_token;
-    size_t total_size;
-    char full_buffer[];
+    size_t buffer_size;
+    char *full_buffer;
 };
 
 
+static void tokens_reserve(token_ctx *token_state, size_t size)
+{   // grow the shared buffer, it is never shrunk so reusing a context stops allocating once it has seen the longest line.
+    if (size <= token_state->buffer_size)
+        return;
+
+    if (size < token_state->buffer_size * 2)
+        size = token_state->buffer_size * 2;
+
+    token_state->full_buffer = (char *)gptk_realloc(token_state->full_buffer, token_state->buffer_size, size);
+    token_state->buffer_size = size;
+}
+
+
+static void tokens_reset(token_ctx *token_state)
+{
+    token_state->curr_token = NULL;
+    token_state->next_token = token_state->full_buffer;
+}
+
+
 token_ctx *tokens_create(const char *input_text, char separator)
 {
-    size_t input_len = strlen(input_text) + 1; // +1 for null terminator
-    size_t total_size = sizeof(token_ctx) + input_len; // Total size including struct and input text
-    token_ctx *token_state = (token_ctx *)gptk_malloc(total_size);
+    token_ctx *token_state = (token_ctx *)gptk_malloc(sizeof(token_ctx));
 
     token_state->separator = separator;
-    token_state->total_size = total_size;
+    token_state->buffer_size = 0;
+    token_state->full_buffer = NULL;
+
+    if (input_text == NULL)
+        input_text = "";
+
+    tokens_reserve(token_state, strlen(input_text) + 1); // +1 for null terminator
     strcpy(token_state->full_buffer, input_text);
-    token_state->curr_token = NULL;
-    token_state->next_token = token_state->full_buffer;
+    tokens_reset(token_state);
 
     return token_state;
 }
@@ -108,10 +284,64 @@ token_ctx *tokens_create(const char *input_text, char separator)
 
 void tokens_free(token_ctx *token_state)
 {
+    free(token_state->full_buffer);
     free(token_state);
 }
 
 
+bool tokens_tabulate(token_ctx *token_state, const char *text)
+{   // splits text on whitespace into separator delimited tokens, quoted text is kept as one token.
+    size_t text_len = strlen(text);
+
+    if (text_len == 0)
+        return false;
+
+    // the output is never longer than the input.
+    tokens_reserve(token_state, text_len + 1);
+
+    char *temp_buffer = token_state->full_buffer;
+    char separator = token_state->separator;
+    size_t t=0;
+    size_t i=0;
+
+    while (i < text_len)
+    {
+        if (text[i] == '"' || text[i] == '\'')
+        {
+            char c = text[i];
+            i += 1;
+
+            while (i < text_len && text[i] != c)
+                temp_buffer[t++] = text[i++];
+
+            temp_buffer[t++] = separator;
+            i++;
+        }
+        else if (text[i] == ' ' || text[i] == '\t')
+        {
+            if (t > 0 && temp_buffer[t-1] != separator)
+                temp_buffer[t++] = separator;
+            i++;
+
+            while (i < text_len && (text[i] == ' ' || text[i] == '\t'))
+                i++;
+        }
+        else
+        {
+            temp_buffer[t++] = text[i++];
+
+            while (i < text_len && text[i] != ' ' && text[i] != '\t')
+                temp_buffer[t++] = text[i++];
+        }
+    }
+    temp_buffer[t] = '\0';
+
+    tokens_reset(token_state);
+
+    return true;
+}
+
+
 const char *tokens_next(token_ctx *token_state)
 {
     if (token_state->next_token == NULL)
@@ -179,55 +409,6 @@ const char *tokens_rest(token_ctx *token_state)
 }
 
 
-char *tabulate_text(const char *text)
-{  
-    char *temp_buffer;
-    int text_len = strlen(text);
-
-    if (text_len == 0)
-        return NULL;
-
-    temp_buffer = (char*)gptk_malloc(text_len+1);
-
-    int t=0;
-    int i=0;
-
-    while (i < text_len)
-    {
-        if (text[i] == '"' || text[i] == '\'')
-        {
-            char c = text[i];
-            i += 1;
-
-            while (text[i] != c && i < text_len)
-                temp_buffer[t++] = text[i++];
-
-            temp_buffer[t++] = '\t';
-            i++;
-        }
-        else if (text[i] == ' ' || text[i] == '\t')
-        {
-            if (t > 0 && temp_buffer[t-1] != '\t')
-                temp_buffer[t++] = '\t';
-            i++;
-
-            while ((text[i] == ' ' || text[i] == '\t') && i < text_len)
-                i++;
-        }
-        else
-        {
-            temp_buffer[t++] = text[i++];
-
-            while (text[i] != ' ' && text[i] != '\t' && i < text_len)
-                temp_buffer[t++] = text[i++];
-        }
-    }
-    temp_buffer[t] = '\0';
-
-    return temp_buffer;
-}
-
-
 // THANKS CHATGPT
 bool strendswith(const char *str, const char *suffix)
 {
@@ -305,18 +486,112 @@ int strncasecmp(const char *s1, const char *s2, size_t n)
 }
 
 
-void emit(int fd, int type, int code, int val)
+static void emit_append(emit_buffer *buffer, int type, int code, int val)
 {
-    struct input_event ev;
+    struct input_event *ev = &buffer->events[buffer->count++];
 
-    ev.type = type;
-    ev.code = code;
-    ev.value = val;
+    ev->type = type;
+    ev->code = code;
+    ev->value = val;
     /* timestamp values below are ignored */
-    ev.time.tv_sec = 0;
-    ev.time.tv_usec = 0;
+    ev->time.tv_sec = 0;
+    ev->time.tv_usec = 0;
+}
+
 
-    write(fd, &ev, sizeof(ev));
+static void emit_end_frame(emit_buffer *buffer)
+{
+    if (buffer->count == buffer->frame_start)
+        return;
+
+    emit_append(buffer, EV_SYN, SYN_REPORT, 0);
+    buffer->frame_start = buffer->count;
+}
+
+
+static void emit_write(emit_buffer *buffer)
+{
+    emit_end_frame(buffer);
+
+    if (buffer->count > 0)
+        write(buffer->fd, buffer->events, sizeof(struct input_event) * buffer->count);
+
+    buffer->count = 0;
+    buffer->frame_start = 0;
+}
+
+
+void emit(int fd, int type, int code, int val)
+{
+    emit_buffer *buffer = NULL;
+
+    if (fd <= 0)
+        return;
+
+    for (int i=0; i < EMIT_MAX_DEVICES; i++)
+    {
+        if (emit_buffers[i].fd == fd)
+        {
+            buffer = &emit_buffers[i];
+            break;
+        }
+
+        if (emit_buffers[i].fd == 0 && buffer == NULL)
+            buffer = &emit_buffers[i];
+    }
+
+    if (buffer == NULL)
+    {   // shouldn't happen, we only have three devices.
+        fprintf(stderr, "emit: no output buffer for fd %d\n", fd);
+        return;
+    }
+
+    buffer->fd = fd;
+
+    if (type == EV_SYN)
+    {
+        if (code == SYN_REPORT)
+            emit_end_frame(buffer);
+
+        return;
+    }
+
+    for (int i=buffer->frame_start; i < buffer->count; i++)
+    {
+        if (buffer->events[i].type == type && buffer->events[i].code == code)
+        {
+            emit_end_frame(buffer);
+            break;
+        }
+    }
+
+    // leave room for the SYN_REPORT
+    if (buffer->count >= EMIT_BUFFER_SIZE - 1)
+        emit_write(buffer);
+
+    emit_append(buffer, type, code, val);
+}
+
+
+void emit_flush()
+{   // write out everything emitted since the last flush.
+    for (int i=0; i < EMIT_MAX_DEVICES; i++)
+    {
+        if (emit_buffers[i].fd == 0)
+            continue;
+
+        emit_write(&emit_buffers[i]);
+    }
+}
+
+
+void emit_forget(int fd)
+{   // drop the buffer of a device that is going away.
+    for (int i=0; i < EMIT_MAX_DEVICES; i++)
+    {
+        if (emit_buffers[i].fd == fd)
+            memset(&emit_buffers[i], 0, sizeof(emit_buffer));
+    }
 }
 
 
@@ -325,19 +600,16 @@ void emitModifier(bool pressed, int modifier)
     if ((modifier & MOD_SHIFT) != 0)
     {
         emit(kb_uinp_fd, EV_KEY, KEY_LEFTSHIFT, pressed ? 1 : 0);
-        emit(kb_uinp_fd, EV_SYN, SYN_REPORT, 0);        
     }
 
     if ((modifier & MOD_ALT) != 0)
     {
         emit(kb_uinp_fd, EV_KEY, KEY_LEFTALT, pressed ? 1 : 0);
-        emit(kb_uinp_fd, EV_SYN, SYN_REPORT, 0);        
     }
 
     if ((modifier & MOD_CTRL) != 0)
     {
         emit(kb_uinp_fd, EV_KEY, KEY_LEFTCTRL, pressed ? 1 : 0);
-        emit(kb_uinp_fd, EV_SYN, SYN_REPORT, 0);        
     }
 }
 
@@ -363,7 +635,6 @@ void emitKey(int fd, int code, bool pressed, int modifier)
     else
     {
         emit(fd, EV_KEY, code, pressed ? 1 : 0);
-        emit(fd, EV_SYN, SYN_REPORT, 0);
     }
 
     if ((modifier != 0) && !(pressed))
@@ -371,29 +642,215 @@ void emitKey(int fd, int code, bool pressed, int modifier)
 }
 
 
-void emitTextInputKey(int code, bool uppercase)
+static bool output_event_before(const output_event *a, const output_event *b)
+{
+    if (a->due != b->due)
+        return (Sint32)(a->due - b->due) < 0;
+
+    return (Sint32)(a->sequence - b->sequence) < 0;
+}
+
+
+static void output_queue_swap(int a, int b)
 {
+    output_event temp = output_queue[a];
+    output_queue[a] = output_queue[b];
+    output_queue[b] = temp;
+}
+
+
+static void output_queue_push(const output_event *new_event)
+{
+    if (output_queue_count >= output_queue_size)
+    {
+        int new_size = (output_queue_size == 0) ? OUTPUT_QUEUE_INITIAL : output_queue_size * 2;
+        output_event *new_queue = (output_event *)gptk_malloc(sizeof(output_event) * new_size);
+
+        if (output_queue != NULL)
+        {
+            memcpy(new_queue, output_queue, sizeof(output_event) * output_queue_count);
+            free(output_queue);
+        }
+
+        output_queue = new_queue;
+        output_queue_size = new_size;
+    }
+
+    int index = output_queue_count++;
+
+    output_queue[index] = *new_event;
+    output_queue[index].sequence = output_queue_sequence++;
+
+    while (index > 0)
+    {
+        int parent = (index - 1) / 2;
+
+        if (!output_event_before(&output_queue[index], &output_queue[parent]))
+            break;
+
+        output_queue_swap(index, parent);
+        index = parent;
+    }
+}
+
+
+void output_queue_key(Uint32 due, int fd, int code, bool pressed, int modifier)
+{   // schedule emitKey(fd, code, pressed, modifier) at due ticks.
+    output_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.due = due;
+    event.fd = fd;
+    event.code = code;
+    event.modifier = modifier;
+    event.pressed = pressed;
+
+    output_queue_push(&event);
+}
+
+
+void output_queue_call(void (*call)(void))
+{   // run call() on the main loop after everything queued so far has been sent.
+    output_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.due = SDL_GetTicks();
+    event.call = call;
+
+    for (int i=0; i < output_queue_count; i++)
+    {
+        if (SDL_TICKS_PASSED(output_queue[i].due, event.due))
+            event.due = output_queue[i].due;
+    }
+
+    output_queue_push(&event);
+}
+
+
+static void output_queue_pop()
+{
+    int index = 0;
+
+    output_queue[0] = output_queue[--output_queue_count];
+
+    while (true)
+    {
+        int smallest = index;
+        int left = index * 2 + 1;
+        int right = left + 1;
+
+        if (left < output_queue_count && output_event_before(&output_queue[left], &output_queue[smallest]))
+            smallest = left;
+
+        if (right < output_queue_count && output_event_before(&output_queue[right], &output_queue[smallest]))
+            smallest = right;
+
+        if (smallest == index)
+            break;
+
+        output_queue_swap(index, smallest);
+        index = smallest;
+    }
+}
+
+
+bool output_queue_next(Uint32 *next_ticks)
+{   // when the next queued key is due, false if the queue is empty.
+    if (output_queue_count == 0)
+        return false;
+
+    *next_ticks = output_queue[0].due;
+    return true;
+}
+
+
+void output_queue_run(Uint32 current_ticks)
+{   // emit everything that is due.
+    while (output_queue_count > 0 && SDL_TICKS_PASSED(current_ticks, output_queue[0].due))
+    {
+        output_event event = output_queue[0];
+
+        output_queue_pop();
+
+        if (event.call != NULL)
+        {   // make sure the keys before it really are out.
+            emit_flush();
+
+            if (!output_queue_draining)
+                event.call();
+        }
+        else
+        {
+            emitKey(event.fd, event.code, event.pressed, event.modifier);
+        }
+    }
+}
+
+
+void output_queue_drain()
+{   // blocks until everything queued has been sent, used when quitting.
+    Uint32 next_ticks;
+
+    // nothing that is queued gets to start anything new now.
+    output_queue_draining = true;
+
+    while (output_queue_next(&next_ticks))
+    {
+        Uint32 current_ticks = SDL_GetTicks();
+
+        if (!SDL_TICKS_PASSED(current_ticks, next_ticks))
+        {
+            emit_flush();
+            SDL_Delay(next_ticks - current_ticks);
+            current_ticks = SDL_GetTicks();
+        }
+
+        output_queue_run(current_ticks);
+    }
+
+    output_queue_draining = false;
+    emit_flush();
+}
+
+
+void output_queue_quit()
+{
+    if (output_queue != NULL)
+        free(output_queue);
+
+    output_queue = NULL;
+    output_queue_count = 0;
+    output_queue_size = 0;
+}
+
+
+void emitTextInputKey(int code, bool uppercase)
+{   // each key gets its own slot after any text that is still being typed.
+    Uint32 start = SDL_GetTicks();
+
+    if (output_queue_count > 0 && SDL_TICKS_PASSED(text_input_tail, start))
+        start = text_input_tail;
+
     if (uppercase)
     {   //capitalise capital letters by holding shift
-        emitKey(kb_uinp_fd, KEY_LEFTSHIFT, true, 0);
+        output_queue_key(start, kb_uinp_fd, KEY_LEFTSHIFT, true, 0);
     }
 
-    emitKey(kb_uinp_fd, code, true, 0);
-    SDL_Delay(16);
-    emitKey(kb_uinp_fd, code, false, 0);
-    SDL_Delay(16);
+    output_queue_key(start, kb_uinp_fd, code, true, 0);
+    output_queue_key(start + TEXT_INPUT_HOLD, kb_uinp_fd, code, false, 0);
 
     if (uppercase)
     {   //release shift if held
-        emitKey(kb_uinp_fd, KEY_LEFTSHIFT, false, 0);
+        output_queue_key(start + TEXT_INPUT_HOLD * 2, kb_uinp_fd, KEY_LEFTSHIFT, false, 0);
     }
+
+    text_input_tail = start + TEXT_INPUT_HOLD * 2;
 }
 
 
 void emitAxisMotion(int code, int value)
 {
     emit(xbox_uinp_fd, EV_ABS, code, value);
-    emit(xbox_uinp_fd, EV_SYN, SYN_REPORT, 0);
 }
 
 
@@ -407,11 +864,6 @@ void emitRelativeMouseMotion(int x, int y)
     {
         emit(kb_uinp_fd, EV_REL, REL_Y, y);
     }
-
-    if (x != 0 || y != 0)
-    {
-        emit(kb_uinp_fd, EV_SYN, SYN_REPORT, 0);
-    }
 }
 
 void emitAbsoluteMouseMotion(int x, int y)
@@ -444,6 +896,8 @@ void emitAbsoluteMouseMotion(int x, int y)
 
     emit(abs_uinp_fd, EV_ABS, ABS_X, scaled_x);
     emit(abs_uinp_fd, EV_ABS, ABS_Y, scaled_y);
+
+    // both axes have to arrive in the same frame.
     emit(abs_uinp_fd, EV_SYN, SYN_REPORT, 0);
 }
 
@@ -453,102 +907,351 @@ void emitMouseWheel(int wheel)
     if (wheel != 0)
     {
         emit(kb_uinp_fd, EV_REL, REL_WHEEL, wheel);
-        emit(kb_uinp_fd, EV_SYN, SYN_REPORT, 0);
     }
 }
 
 
-#define KILL_BUFFER 1024
+#define PROCESS_READ_MAX 4096
 
-bool process_with_pkill(const char *process_name, bool use_sudo)
-{
-    char temp_buffer[KILL_BUFFER];
+/* The quit combo finds the program by name in /proc instead of running pkill
+ * or ps through a shell, and does it on a thread so the input loop doesn't
+ * stall while it looks. A process matches if its comm, or the file name of
+ * its first or second argument, is exactly the name we were given. That
+ * covers names too long for comm and programs run through box64, mono and
+ * the like, without catching sudo, timeout or us that just have the name
+ * somewhere in their arguments.
+ */
 
-    if (use_sudo)
-        snprintf(temp_buffer, KILL_BUFFER, "sudo pkill -9 '%s'", process_name);
-    else
-        snprintf(temp_buffer, KILL_BUFFER, "pkill -9 '%s'", process_name);
+// one scan at a time, the thread only reads these.
+static char process_kill_name[MAX_PROCESS_NAME];
+static bool process_kill_sudo = false;
+static bool process_kill_first = false;
 
-    // Execute the command
-    int status = system(temp_buffer);
+static int process_kill_busy = 0;
+static int process_kill_fds[2] = {-1, -1};
 
-    // Check if the command executed successfully
-    if (status == -1)
-        return false;
 
-    return true;
+static ssize_t process_read(const char *path, char *buffer, size_t size)
+{   // reads up to size - 1 bytes and NUL terminates them, -1 if it can't be opened.
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return -1;
+
+    ssize_t length = read(fd, buffer, size - 1);
+    close(fd);
+
+    if (length < 0)
+        return -1;
+
+    buffer[length] = '\0';
+    return length;
 }
 
 
-bool process_with_kill(const char *process_name, bool use_sudo)
+static const char *process_basename(const char *path)
 {
-    char temp_buffer[KILL_BUFFER];
-    bool status = false;
+    const char *name = strrchr(path, '/');
+
+    return (name != NULL) ? name + 1 : path;
+}
+
+
+static bool process_matches(long pid, const char *process_name, const char *own_comm)
+{
+    char path[64];
+    char buffer[PROCESS_READ_MAX];
+    ssize_t length;
+
+    snprintf(path, sizeof(path), "/proc/%ld/comm", pid);
+
+    if (process_read(path, buffer, sizeof(buffer)) < 0)
+        return false;
 
-    snprintf(temp_buffer, KILL_BUFFER, "ps | grep '%s' | grep -v grep | awk '{print $1}'", process_name);
+    buffer[strcspn(buffer, "\n")] = '\0';
 
-    FILE *fp = popen(temp_buffer, "r");
-    if (fp == NULL) {
-        perror("Error executing ps command");
+    // other gptokeyb2s have the name in their arguments too.
+    if (strcmp(buffer, own_comm) == 0)
         return false;
+
+    if (strcmp(buffer, process_name) == 0)
+        return true;
+
+    snprintf(path, sizeof(path), "/proc/%ld/cmdline", pid);
+
+    length = process_read(path, buffer, sizeof(buffer));
+
+    // argv[0] and argv[1] only.
+    for (ssize_t offset=0, i=0; offset < length && i < 2; offset += strlen(buffer + offset) + 1, i++)
+    {
+        if (strcmp(process_basename(buffer + offset), process_name) == 0)
+            return true;
     }
 
+    return false;
+}
+
+
+static bool process_sudo_kill(long pid)
+{   // not ours to kill, ask sudo without going through a shell.
     char pid_str[32];
+    int status;
+
+    snprintf(pid_str, sizeof(pid_str), "%ld", pid);
 
-    if (fgets(pid_str, sizeof(pid_str), fp) != NULL)
+    pid_t sudo_pid = fork();
+
+    if (sudo_pid < 0)
+        return false;
+
+    if (sudo_pid == 0)
     {
-        // Trim the newline character
-        pid_str[strcspn(pid_str, "\n")] = 0;
+        execlp("sudo", "sudo", "kill", "-9", pid_str, (char *)NULL);
+        _exit(127);
+    }
 
-        // Convert string to integer
-        int pid = atoi(pid_str);
+    while (waitpid(sudo_pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+            return false;
+    }
+
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+
+static bool process_signal(long pid, bool use_sudo)
+{
+    if (kill((pid_t)pid, SIGKILL) == 0)
+        return true;
+
+    if (errno == EPERM && use_sudo)
+        return process_sudo_kill(pid);
+
+    fprintf(stderr, "Unable to kill %ld: %s\n", pid, strerror(errno));
+    return false;
+}
+
+
+static int process_scan(const char *process_name, bool use_sudo, bool first_only)
+{   // kills whatever matches, returns how many or -1 if /proc can't be read.
+    char own_comm[64] = "";
+    struct dirent *entry;
+    long own_pid = (long)getpid();
+    int killed = 0;
+
+    DIR *dir = opendir("/proc");
+
+    if (dir == NULL)
+    {
+        fprintf(stderr, "Unable to read /proc: %s\n", strerror(errno));
+        return -1;
+    }
+
+    process_read("/proc/self/comm", own_comm, sizeof(own_comm));
+    own_comm[strcspn(own_comm, "\n")] = '\0';
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        char *end;
+        long pid = strtol(entry->d_name, &end, 10);
+
+        if (*end != '\0' || pid <= 0 || pid == own_pid)
+            continue;
+
+        if (!process_matches(pid, process_name, own_comm))
+            continue;
+
+        if (!process_signal(pid, use_sudo))
+            continue;
+
+        printf("Process with name '%s' and PID %ld killed successfully.\n", process_name, pid);
+        killed++;
+
+        if (first_only)
+            break;
+    }
+
+    closedir(dir);
+
+    return killed;
+}
 
-        // Kill the process
-        if (use_sudo)
-            snprintf(temp_buffer, KILL_BUFFER, "sudo kill -9 %d", pid);
-        else
-            snprintf(temp_buffer, KILL_BUFFER, "kill -9 %d", pid);
 
-        int status = system(temp_buffer);
-        if (status == -1)
+static bool process_with_pkill(const char *process_name, bool use_sudo)
+{   // like pkill, every match is killed and it is fine if there wasn't one.
+    return (process_scan(process_name, use_sudo, false) >= 0);
+}
+
+
+static bool process_with_kill(const char *process_name, bool use_sudo)
+{   // only the first match, and only done if there was one.
+    int killed = process_scan(process_name, use_sudo, true);
+
+    if (killed == 0)
+        printf("No process with name '%s' found.\n", process_name);
+
+    return (killed > 0);
+}
+
+
+static int process_kill_thread(void *data)
+{
+    char result;
+    (void)data;
+
+    if (process_kill_first)
+        result = process_with_kill(process_kill_name, process_kill_sudo);
+    else
+        result = process_with_pkill(process_kill_name, process_kill_sudo);
+
+    // the main thread clears busy once it has the result, until then the pipe stays open.
+    if (write(process_kill_fds[1], &result, sizeof(result)) != sizeof(result))
+    {
+        fprintf(stderr, "Unable to report the kill: %s\n", strerror(errno));
+        __atomic_store_n(&process_kill_busy, 0, __ATOMIC_RELEASE);
+    }
+
+    return 0;
+}
+
+
+static void process_kill_callback(int fd, void *data)
+{
+    char result;
+    (void)data;
+
+    while (read(fd, &result, sizeof(result)) == sizeof(result))
+    {
+        __atomic_store_n(&process_kill_busy, 0, __ATOMIC_RELEASE);
+
+        // a daemon client might have started something else in the meantime.
+        if (result && strcmp(process_kill_name, kill_process_name) == 0)
+            state_process_killed();
+    }
+}
+
+
+static bool process_kill_start()
+{   // false if the thread couldn't be started, true if it is (or already was) looking.
+    if (__atomic_load_n(&process_kill_busy, __ATOMIC_ACQUIRE))
+        return true;
+
+    if (process_kill_fds[0] < 0)
+    {
+        if (pipe(process_kill_fds) < 0)
         {
-            perror("Error executing kill command");
+            fprintf(stderr, "Unable to create the kill pipe: %s\n", strerror(errno));
+            return false;
         }
-        else
+
+        fcntl(process_kill_fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(process_kill_fds[1], F_SETFD, FD_CLOEXEC);
+        fcntl(process_kill_fds[0], F_SETFL, O_NONBLOCK);
+
+        if (!loop_watch_fd(process_kill_fds[0], process_kill_callback, NULL))
         {
-            status = true;
-            printf("Process with name '%s' and PID %d killed successfully.\n", process_name, pid);
+            close(process_kill_fds[0]);
+            close(process_kill_fds[1]);
+            process_kill_fds[0] = process_kill_fds[1] = -1;
+            return false;
         }
     }
-    else
+
+    strncpy(process_kill_name, kill_process_name, MAX_PROCESS_NAME - 1);
+    process_kill_name[MAX_PROCESS_NAME - 1] = '\0';
+    process_kill_sudo = want_sudo;
+    process_kill_first = want_kill;
+
+    __atomic_store_n(&process_kill_busy, 1, __ATOMIC_RELEASE);
+
+    SDL_Thread *thread = SDL_CreateThread(process_kill_thread, "gptk_kill", NULL);
+
+    if (thread == NULL)
     {
-        printf("No process with name '%s' found.\n", process_name);
+        fprintf(stderr, "Unable to start the kill thread: %s\n", SDL_GetError());
+        __atomic_store_n(&process_kill_busy, 0, __ATOMIC_RELEASE);
+        return false;
     }
 
-    pclose(fp);
+    SDL_DetachThread(thread);
+    return true;
+}
+
 
-    return status;
+void process_quit()
+{   // a thread that is still looking, or whose result we haven't read, keeps its pipe.
+    if (process_kill_fds[0] < 0 || __atomic_load_n(&process_kill_busy, __ATOMIC_ACQUIRE))
+        return;
+
+    loop_unwatch_fd(process_kill_fds[0]);
+    close(process_kill_fds[0]);
+    close(process_kill_fds[1]);
+    process_kill_fds[0] = process_kill_fds[1] = -1;
 }
 
 
 void process_with_pc_quit()
 {
-    emitKey(kb_uinp_fd, KEY_F4, true, KEY_LEFTALT);
-    SDL_Delay(15);
+    static Uint32 pc_quit_until = 0;
+    Uint32 current_ticks = SDL_GetTicks();
+
+    // don't flood the queue if the combo is pressed again straight away.
+    if (pc_quit_until != 0 && !SDL_TICKS_PASSED(current_ticks, pc_quit_until))
+        return;
 
-    emitKey(kb_uinp_fd, KEY_F4, false, KEY_LEFTALT);
-    SDL_Delay(15);
+    output_queue_key(current_ticks, kb_uinp_fd, KEY_F4, true, MOD_ALT);
+    output_queue_key(current_ticks + PC_QUIT_HOLD, kb_uinp_fd, KEY_F4, false, MOD_ALT);
+
+    pc_quit_until = current_ticks + PC_QUIT_HOLD * 2;
 }
 
 
-bool process_kill()
+bool runtime_path(char *path, size_t size, const char *suffix)
+{   // $XDG_RUNTIME_DIR/gptokeyb2<suffix>, or one per user in /tmp.
+    const char *runtime_dir = SDL_getenv("XDG_RUNTIME_DIR");
+    int length;
+
+    if (runtime_dir != NULL && strlen(runtime_dir) > 0)
+        length = snprintf(path, size, "%s/gptokeyb2%s", runtime_dir, suffix);
+    else
+        length = snprintf(path, size, "/tmp/gptokeyb2-%u%s", (unsigned)getuid(), suffix);
+
+    return (length > 0 && (size_t)length < size);
+}
+
+
+bool runtime_path_ours(const char *path)
+{   // the /tmp fallback is shared with everyone, whatever is there has to be a socket we made.
+    struct stat info;
+
+    if (lstat(path, &info) < 0)
+        return (errno == ENOENT);
+
+    if (!S_ISSOCK(info.st_mode) || info.st_uid != getuid())
+    {
+        fprintf(stderr, "'%s' doesn't belong to us, ignoring it.\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool process_kill_now()
 {
-    if (want_pc_quit)
-        process_with_pc_quit();
+    if (child_running())
+    {   // --exec, we know exactly which process it is.
+        return child_signal(SIGKILL);
+    }
 
     if (strlen(kill_process_name) == 0)
         return false;
 
+    // state_process_killed() is called once the thread has done it.
+    if (process_kill_start())
+        return false;
+
     if (want_kill)
         return process_with_kill(kill_process_name, want_sudo);
 
@@ -556,53 +1259,136 @@ bool process_kill()
 }
 
 
+static void process_kill_queued()
+{
+    if (process_kill_now())
+        state_process_killed();
+}
+
+
+bool process_kill()
+{
+    if (!want_pc_quit)
+        return process_kill_now();
+
+    process_with_pc_quit();
+
+    // let the program see alt+f4 before we kill it, the input loop keeps going in the meantime.
+    if (child_running() || strlen(kill_process_name) > 0)
+        output_queue_call(process_kill_queued);
+
+    return false;
+}
+
+
+static Uint32 string_hash(const char *string)
+{   // FNV-1a
+    Uint32 hash = 2166136261u;
+
+    while (*string != '\0')
+    {
+        hash ^= (Uint8)*string++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
 string_reg *string_reg_create(const char *string)
 {
     if (string == NULL)
         return NULL;
 
-    string_reg *current_string = (string_reg *)gptk_malloc(sizeof(string_reg));
     size_t string_len = strlen(string);
 
-    current_string->string = (char *)gptk_malloc(string_len + 1);
+    // the text lives straight after the entry.
+    string_reg *current_string = (string_reg *)arena_alloc(load_arena, sizeof(string_reg) + string_len + 1);
+
+    current_string->string = (char *)(current_string + 1);
+    current_string->hash = string_hash(string);
 
     memcpy(current_string->string, string, string_len + 1);
 
     return current_string;
 }
 
+
+static void string_table_resize(size_t new_size)
+{
+    string_reg **new_table = (string_reg **)gptk_malloc(sizeof(string_reg *) * new_size);
+
+    for (size_t i=0; i < string_table_size; i++)
+    {
+        string_reg *current_string = string_table[i];
+
+        while (current_string != NULL)
+        {
+            string_reg *next_string = current_string->next;
+            size_t bucket = current_string->hash & (new_size - 1);
+
+            current_string->next = new_table[bucket];
+            new_table[bucket] = current_string;
+
+            current_string = next_string;
+        }
+    }
+
+    if (string_table != NULL)
+        free(string_table);
+
+    string_table = new_table;
+    string_table_size = new_size;
+    string_resizes++;
+}
+
+
 void string_init()
 {
-    root_string = string_reg_create("controls");
+    string_count = 0;
+    string_lookups = 0;
+    string_compares = 0;
+
+    string_table_resize(STRING_TABLE_INITIAL);
+    string_resizes = 0;
+    string_register("controls");
 }
 
 void string_quit()
-{
-    string_reg *current_string = root_string;
-    string_reg *next_string;
-    int total_strings = 0;
-    int total_lookups = 0;
-    int lookup_factor = 0;
+{   // the strings themselves go with load_arena.
+    if (string_table != NULL)
+        free(string_table);
 
-    // printf("# String Quit\n");
-    int i=1;
-    while (current_string != NULL)
+    string_table = NULL;
+    string_table_size = 0;
+    string_count = 0;
+}
+
+void string_dump_stats()
+{   // prints how well the string table is doing, as ini comments.
+    size_t used_buckets = 0;
+    size_t longest_chain = 0;
+
+    for (size_t i=0; i < string_table_size; i++)
     {
-        next_string = current_string->next;
+        size_t chain = 0;
 
-        total_strings++;
-        total_lookups += current_string->counter;
-        lookup_factor += i * current_string->counter;
+        for (string_reg *current_string = string_table[i]; current_string != NULL; current_string = current_string->next)
+            chain++;
 
-        // printf("# - %s\n", current_string->string);
-        free(current_string->string);
-        free(current_string);
+        if (chain > 0)
+            used_buckets++;
 
-        current_string = next_string;
-        i++;
+        if (chain > longest_chain)
+            longest_chain = chain;
     }
 
-    // printf("# Stats: %d, %d, %d\n", total_strings, total_lookups, lookup_factor);
+    printf("# strings: %zu, buckets: %zu/%zu, longest chain: %zu, resizes: %zu\n",
+        string_count, used_buckets, string_table_size, longest_chain, string_resizes);
+    printf("# lookups: %zu, compares: %zu (%.2f per lookup)\n",
+        string_lookups, string_compares,
+        (string_lookups > 0) ? (double)string_compares / (double)string_lookups : 0.0);
+    printf("# arena: %zu bytes\n", arena_allocated(load_arena));
 }
 
 const char *string_register(const char *string)
@@ -610,25 +1396,37 @@ const char *string_register(const char *string)
     if (string == NULL)
         return NULL;
 
-    string_reg *current_string = root_string;
-    string_reg *last_string = NULL;
+    Uint32 hash = string_hash(string);
+    string_reg *current_string = string_table[hash & (string_table_size - 1)];
+
+    string_lookups++;
 
     while (current_string != NULL)
     {
-        last_string = current_string;
-
-        if (strcmp(current_string->string, string) == 0)
+        if (current_string->hash == hash)
         {
-            current_string->counter++;
-            return current_string->string;
+            string_compares++;
+
+            if (strcmp(current_string->string, string) == 0)
+            {
+                current_string->counter++;
+                return current_string->string;
+            }
         }
 
         current_string = current_string->next;
     }
 
+    if ((string_count + 1) > (string_table_size / 4 * 3))
+        string_table_resize(string_table_size * 2);
+
+    size_t bucket = hash & (string_table_size - 1);
+
     current_string = string_reg_create(string);
     current_string->counter++;
-    last_string->next = current_string;
+    current_string->next = string_table[bucket];
+    string_table[bucket] = current_string;
+    string_count++;
 
     return current_string->string;
 }
@@ -0,0 +1,209 @@
+/* Copyright (c) 2021-2024
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public
+* License as published by the Free Software Foundation; either
+* version 2 of the License, or (at your option) any later version.
+#
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* General Public License for more details.
+#
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the
+* Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA 02110-1301 USA
+#
+* Authored by: Kris Henriksen <krishenriksen.work@gmail.com>
+#
+* AnberPorts-Keyboard-Mouse
+*
+* Part of the code is from from https://github.com/krishenriksen/AnberPorts/blob/master/AnberPorts-Keyboard-Mouse/main.c (mostly the fake keyboard)
+* Fake Xbox code from: https://github.com/Emanem/js2xbox
+*
+* Modified (badly) by: Shanti Gilbert for EmuELEC
+* Modified further by: Nikolai Wuttke for EmuELEC (Added support for SDL and the SDLGameControllerdb.txt)
+* Modified further by: Jacob Smith
+*
+* Any help improving this code would be greatly appreciated!
+*
+* DONE: Xbox360 mode: Fix triggers so that they report from 0 to 255 like real Xbox triggers
+*       Xbox360 mode: Figure out why the axis are not correctly labeled?  SDL_CONTROLLER_AXIS_RIGHTX / SDL_CONTROLLER_AXIS_RIGHTY / SDL_CONTROLLER_AXIS_TRIGGERLEFT / SDL_CONTROLLER_AXIS_TRIGGERRIGHT
+*       Keyboard mode: Add a config file option to load mappings from.
+*       add L2/R2 triggers
+*
+*/
+
+#include "gptokeyb2.h"
+
+#include <math.h>
+
+/* Runs every fixed point deadzone in analog_fixed.c and its float version in
+ * analog.c over a grid of stick positions and deadzones, and fails if they
+ * are further apart than the limits below.
+ *
+ * Errors are in Q15 steps (1/32768), relative to the value once it is past
+ * 1.0. Deadzones only go up to half the stick, past that hybrid in the
+ * float code divides by (1 - deadzone * |x|) and goes through zero.
+ */
+
+// analog.c wants this for deadzone_mouse_calc().
+gptokeyb_state current_state;
+
+#define DEADZONE_TEST_EXP_MODE 6
+#define DEADZONE_TEST_MODES 7
+
+static const char *mode_names[DEADZONE_TEST_MODES] = {
+    "axial",
+    "radial",
+    "scaled_radial",
+    "sloped_axial",
+    "sloped_scaled_axial",
+    "hybrid",
+    "exp",
+};
+
+static const double mode_limits[DEADZONE_TEST_MODES] = {
+    0.0,    // axial
+    0.0,    // radial
+    2.5,    // scaled_radial
+    0.0,    // sloped_axial
+    1.5,    // sloped_scaled_axial
+    4.0,    // hybrid
+    8.0,    // exp
+};
+
+static const int deadzones[] = {0, 1, 500, 1000, 2000, 4000, 8000, 12000, 16000};
+
+// dz_exp() is only held to this for n >= 1, below that it is as steep as you like at the deadzone.
+static const float exp_powers[] = {1.0f, 1.5f, 2.0f, 3.0f};
+
+static double mode_worst[DEADZONE_TEST_MODES];
+static long tests_run = 0;
+
+
+static double axis_error(float expected, Sint32 actual)
+{
+    double error = fabs((double)expected * 32768.0 - (double)actual);
+
+    if (fabs(expected) > 1.0)
+        error /= fabs(expected);
+
+    return error;
+}
+
+
+static void check(int mode, const vector2d *expected, const vector2q *actual, int in_x, int in_y, int deadzone)
+{
+    double error = axis_error(expected->x, actual->x);
+    double error_y = axis_error(expected->y, actual->y);
+
+    if (error_y > error)
+        error = error_y;
+
+    if (error > mode_limits[mode] && error > mode_worst[mode])
+    {
+        fprintf(stderr, "%s: (%d, %d) deadzone %d: float (%f, %f) fixed (%d, %d)\n",
+            mode_names[mode], in_x, in_y, deadzone,
+            expected->x * 32768.0f, expected->y * 32768.0f, actual->x, actual->y);
+    }
+
+    if (error > mode_worst[mode])
+        mode_worst[mode] = error;
+
+    tests_run++;
+}
+
+
+static void check_position(int in_x, int in_y, int deadzone)
+{
+    vector2d input = {(float)in_x / 32768.0f, (float)in_y / 32768.0f};
+    vector2q input_q = {in_x, in_y};
+    float dz = (float)deadzone / 32768.0f;
+    vector2d output;
+    vector2q output_q;
+
+    // 0 / 0 in the float code.
+    if (deadzone == 0 && in_x == 0 && in_y == 0)
+        return;
+
+#define CHECK_MODE(mode, dz_func, dzq_func) \
+    vector2d_clear(&output); \
+    output_q.x = output_q.y = 0; \
+    dz_func(&output, &input, dz); \
+    dzq_func(&output_q, &input_q, deadzone); \
+    check(mode, &output, &output_q, in_x, in_y, deadzone);
+
+    CHECK_MODE(0, dz_axial, dzq_axial)
+    CHECK_MODE(1, dz_radial, dzq_radial)
+    CHECK_MODE(2, dz_scaled_radial, dzq_scaled_radial)
+    CHECK_MODE(3, dz_sloped_axial, dzq_sloped_axial)
+    CHECK_MODE(4, dz_sloped_scaled_axial, dzq_sloped_scaled_axial)
+    CHECK_MODE(5, dz_hybrid, dzq_hybrid)
+
+#undef CHECK_MODE
+
+    for (size_t i=0; i < sizeof(exp_powers) / sizeof(exp_powers[0]); i++)
+    {
+        vector2d_clear(&output);
+        output_q.x = output_q.y = 0;
+
+        dz_exp(&output, &input, dz, exp_powers[i]);
+        dzq_exp(&output_q, &input_q, deadzone, (Sint32)(exp_powers[i] * 65536.0f));
+
+        check(DEADZONE_TEST_EXP_MODE, &output, &output_q, in_x, in_y, deadzone);
+    }
+}
+
+
+static void check_grid(int from, int to, int step, int deadzone)
+{   // to is always included, so both ends of the axis get tested.
+    for (int x=from; ; x += step)
+    {
+        if (x > to)
+            x = to;
+
+        for (int y=from; ; y += step)
+        {
+            if (y > to)
+                y = to;
+
+            check_position(x, y, deadzone);
+
+            if (y == to)
+                break;
+        }
+
+        if (x == to)
+            break;
+    }
+}
+
+
+int main()
+{
+    bool failed = false;
+
+    for (size_t i=0; i < sizeof(deadzones) / sizeof(deadzones[0]); i++)
+    {
+        // the whole stick, and finer around the middle where the deadzones are.
+        check_grid(-32768, 32767, 256, deadzones[i]);
+        check_grid(-2048, 2048, 32, deadzones[i]);
+    }
+
+    for (int mode=0; mode < DEADZONE_TEST_MODES; mode++)
+    {
+        bool passed = (mode_worst[mode] <= mode_limits[mode]);
+
+        printf("%-20s worst %7.3f limit %5.1f  %s\n",
+            mode_names[mode], mode_worst[mode], mode_limits[mode], passed ? "ok" : "FAILED");
+
+        if (!passed)
+            failed = true;
+    }
+
+    printf("%ld comparisons\n", tests_run);
+
+    return (failed ? 1 : 0);
+}
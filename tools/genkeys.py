@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+#
+# Generates perfect hash tables for the key and button names in src/keys.c.
+#
+# The key list in src/keys.c stays the source of truth, any KEY_* name from
+# linux/input-event-codes.h that isn't already in there is added with the
+# KEY_ prefix stripped and lowercased. Earlier entries always win, so the
+# lookups return exactly what the old linear scans did.
+#
+# The hashes have to match keys_hash() in src/keys.c.
+
+import argparse
+import re
+import sys
+
+FNV_OFFSET = 2166136261
+FNV_PRIME = 16777619
+MAX_DISPLACE = 0xFFFF
+
+SKIP_KEYS = {"KEY_RESERVED", "KEY_MAX", "KEY_CNT", "KEY_MIN_INTERESTING"}
+
+
+def fold(text):
+    # ascii only, same as tolower() in the C locale.
+    return "".join(chr(ord(c) + 32) if "A" <= c <= "Z" else c for c in text)
+
+
+def keys_hash(text, seed, folded):
+    value = (FNV_OFFSET ^ seed) & 0xFFFFFFFF
+
+    if folded:
+        text = fold(text)
+
+    for byte in text.encode("latin-1"):
+        value ^= byte
+        value = (value * FNV_PRIME) & 0xFFFFFFFF
+
+    return value
+
+
+def c_unescape(text):
+    return re.sub(r"\\(.)", lambda m: {"n": "\n", "t": "\t"}.get(m.group(1), m.group(1)), text)
+
+
+def c_escape(text):
+    return text.replace("\\", "\\\\").replace("\"", "\\\"")
+
+
+def parse_table(source, name):
+    match = re.search(name + r"\[\]\s*=\s*\{(.*?)\n\};", source, re.S)
+    if match is None:
+        sys.exit("genkeys: unable to find %s[] in keys.c" % name)
+
+    entry_re = re.compile(r'\{\s*"((?:[^"\\]|\\.)*)"\s*,\s*(\w+)\s*(?:,\s*(\w+)\s*)?\}')
+
+    return [(c_unescape(m.group(1)), m.group(2), m.group(3)) for m in entry_re.finditer(match.group(1))]
+
+
+def parse_codes(header):
+    defines = {}
+
+    for match in re.finditer(r"^#define\s+((?:KEY|BTN)_\w+)\s+(\S+)", header, re.M):
+        defines[match.group(1)] = match.group(2)
+
+    values = {}
+
+    def resolve(name, depth=0):
+        if name in values:
+            return values[name]
+
+        value = defines.get(name)
+        if value is None or depth > 8:
+            return None
+
+        try:
+            result = int(value, 0)
+        except ValueError:
+            result = resolve(value, depth + 1)
+
+        values[name] = result
+        return result
+
+    for name in defines:
+        resolve(name)
+
+    return {name: value for name, value in values.items() if value is not None}
+
+
+def build_perfect_hash(names, folded):
+    """hash and displace: the first hash picks a bucket, each bucket gets a seed that
+    puts all of its names into free slots of the second table."""
+    count = max(len(names), 1)
+    buckets = max(count // 4, 1)
+    size = count + count // 4 + 1
+
+    while True:
+        groups = [[] for _ in range(buckets)]
+
+        for index, name in enumerate(names):
+            groups[keys_hash(name, 0, folded) % buckets].append(index)
+
+        slots = [-1] * size
+        displace = [0] * buckets
+        ok = True
+
+        for bucket in sorted(range(buckets), key=lambda b: -len(groups[b])):
+            if not groups[bucket]:
+                break
+
+            for seed in range(1, MAX_DISPLACE + 1):
+                wanted = [keys_hash(names[i], seed, folded) % size for i in groups[bucket]]
+
+                if len(set(wanted)) == len(wanted) and all(slots[s] == -1 for s in wanted):
+                    for slot, index in zip(wanted, groups[bucket]):
+                        slots[slot] = index
+
+                    displace[bucket] = seed
+                    break
+            else:
+                ok = False
+                break
+
+        if ok:
+            return displace, slots
+
+        size += size // 8 + 1
+
+
+def emit_array(out, ctype, name, values, per_line=16):
+    out.append("static const %s %s[%d] = {" % (ctype, name, len(values)))
+
+    for i in range(0, len(values), per_line):
+        out.append("    " + ", ".join(str(v) for v in values[i:i + per_line]) + ",")
+
+    out.append("};")
+    out.append("")
+
+
+def emit_hash(out, prefix, names, indices, folded):
+    """names are unique lookup strings, indices what each one resolves to."""
+    displace, slots = build_perfect_hash(names, folded)
+
+    out.append("#define %s_BUCKETS %d" % (prefix.upper(), len(displace)))
+    out.append("#define %s_SIZE %d" % (prefix.upper(), len(slots)))
+    out.append("")
+
+    emit_array(out, "Uint16", prefix + "_displace", displace)
+    emit_array(out, "Sint16", prefix + "_slots", [indices[s] if s >= 0 else -1 for s in slots])
+
+
+def unique_names(entries, folded):
+    """first entry wins, returns (names, indices)."""
+    seen = set()
+    names = []
+    indices = []
+
+    for index, name in enumerate(entries):
+        key = fold(name) if folded else name
+
+        if key in seen:
+            continue
+
+        seen.add(key)
+        names.append(name)
+        indices.append(index)
+
+    return names, indices
+
+
+def main():
+    parser = argparse.ArgumentParser(description="generate key lookup tables for gptokeyb2")
+    parser.add_argument("--keys", required=True, help="path to src/keys.c")
+    parser.add_argument("--codes", required=True, help="path to linux/input-event-codes.h")
+    parser.add_argument("--output", required=True, help="header to write")
+    args = parser.parse_args()
+
+    with open(args.keys, encoding="utf-8") as fh:
+        source = fh.read()
+
+    with open(args.codes, encoding="utf-8") as fh:
+        codes = parse_codes(fh.read())
+
+    keyboard = parse_table(source, "keyboard_codes")
+    buttons = parse_table(source, "button_codes")
+
+    key_max = codes.get("KEY_MAX", 0x2ff)
+
+    for name, code, _ in keyboard:
+        if code not in codes:
+            sys.exit("genkeys: unknown keycode %s for '%s'" % (code, name))
+
+    # extra names from the kernel header
+    known = set(fold(name) for name, _, _ in keyboard)
+    extra = []
+
+    for symbol, value in sorted(codes.items(), key=lambda item: (item[1], item[0])):
+        if not symbol.startswith("KEY_") or symbol in SKIP_KEYS or value > key_max:
+            continue
+
+        name = fold(symbol[4:])
+
+        if name in known:
+            continue
+
+        known.add(name)
+        extra.append((name, symbol, value))
+
+    all_names = [name for name, _, _ in keyboard] + [name for name, _, _ in extra]
+    all_codes = [codes[code] for _, code, _ in keyboard] + [value for _, _, value in extra]
+
+    out = []
+    out.append("/* Generated by tools/genkeys.py from src/keys.c and linux/input-event-codes.h, do not edit. */")
+    out.append("")
+    out.append("#ifndef __KEYS_GEN_H__")
+    out.append("#define __KEYS_GEN_H__")
+    out.append("")
+    out.append("#define KEYBOARD_CODES_COUNT %d" % len(keyboard))
+    out.append("#define KEYBOARD_CODES_EXTRA_COUNT %d" % len(extra))
+    out.append("#define BUTTON_CODES_COUNT %d" % len(buttons))
+    out.append("#define KEYCODE_NAMES_COUNT %d" % (key_max + 1))
+    out.append("")
+
+    out.append("static const keyboard_values keyboard_codes_extra[%d] = {" % max(len(extra), 1))
+    for name, symbol, value in extra:
+        out.append("    {\"%s\", %d, 0}, // %s" % (c_escape(name), value, symbol))
+    if not extra:
+        out.append("    {NULL, 0, 0},")
+    out.append("};")
+    out.append("")
+
+    # keycode -> first name that produces it.
+    keycode_index = [-1] * (key_max + 1)
+    for index, code in enumerate(all_codes):
+        if 0 <= code <= key_max and keycode_index[code] == -1:
+            keycode_index[code] = index
+
+    emit_array(out, "Sint16", "keycode_index", keycode_index)
+
+    names, indices = unique_names(all_names, False)
+    emit_hash(out, "keyboard_exact", names, indices, False)
+
+    names, indices = unique_names(all_names, True)
+    emit_hash(out, "keyboard_folded", names, indices, True)
+
+    names, indices = unique_names([name for name, _, _ in buttons], True)
+    emit_hash(out, "button_folded", names, indices, True)
+
+    out.append("#endif /* __KEYS_GEN_H__ */")
+
+    with open(args.output, "w", encoding="utf-8") as fh:
+        fh.write("\n".join(out) + "\n")
+
+
+if __name__ == "__main__":
+    main()